@@ -16,6 +16,7 @@ static int vertpad            = 10;       /* vertical padding of bar */
 static int sidepad            = 10;       /* horizontal padding of bar */
 static int user_bh            = 23;        /* 0 means that dwm will calculate bar height, >= 1 means dwm will user_bh as bar height */
 static int dmenu_bw           = 5;
+static const int batchdraw    = 1;        /* 1 means bar text and rects are queued and drawn in a few requests per colour */
 static char font[]            = "monospace:size=10";
 static char dmenufont[]       = "monospace:size=10";
 static char normbgcolor[]     = "#222222";
@@ -50,6 +51,7 @@ static int attachdirection = 4;    /* 0 default, 1 above, 2 aside, 3 below, 4 bo
 /* --constants-- */
 #define ICONSIZE (bh - 4)   /* icon size */
 #define ICONSPACING 5 /* space between icon and title */
+static const unsigned int maxicons = 64; /* icon pictures kept loaded, 0 means no limit */
 
 /* alt-tab configuration */
 static const unsigned int tabModKey 		= 0x40;	/* if this key is hold the alt-tab functionality stays acitve. This key must be the same as key that is used to active functin altTabStart `*/
@@ -98,6 +100,7 @@ static const unsigned int tagalpha[]     = { OPAQUE, baralpha };
 /* window swallowing */
 static const int swaldecay = 3;
 static const int swalretroactive = 1;
+static const int swalauto = 1;        /* 1 means windows swallow the isterminal window they were started from */
 static const char swalsymbol[] = "ﳺ";
 
 /* focus */
@@ -205,9 +208,12 @@ static const Rule rules[] = {
 	 *	WM_CLASS(STRING) = instance, class
 	 *	WM_NAME(STRING) = title
 	 */
-	/* class      instance    title       tags mask     isfloating   monitor    float x,y,w,h  isfakefullscreen*/
-//{ "Gimp",     NULL,       NULL,       0,            1,           -1,        50,50,500,500, 0 },
-	{ "Firefox",  NULL,       NULL,       1 << 8,       0,           -1,        50,50,500,500, 0 },
+	/* class      instance    title           tags mask     isfloating   monitor    float x,y,w,h  isfakefullscreen isterminal noswallow */
+//{ "Gimp",     NULL,       NULL,           0,            1,           -1,        50,50,500,500, 0,               0,         0 },
+	{ "Firefox",  NULL,       NULL,           1 << 8,       0,           -1,        50,50,500,500, 0,               0,         0 },
+	{ "St",       NULL,       NULL,           0,            0,           -1,        50,50,500,500, 0,               1,         0 },
+	{ "tabbed",   NULL,       NULL,           0,            0,           -1,        50,50,500,500, 0,               1,         0 }, /* termcmd */
+	{ NULL,       NULL,       "Event Tester", 0,            0,           -1,        50,50,500,500, 0,               0,         1 }, /* xev */
 };
 static const MonitorRule monrules[] = {
 	/* monitor  tag  layout  mfact  nmaster  showbar  topbar */
@@ -234,11 +240,21 @@ static const MonitorRule monrules[] = {
 /* commands */
 static char dmenumon[2] = "0"; /* component of dmenucmd, manipulated in spawn() */
 static const char *dmenucmd[] = { "dmenu_run", "-m", dmenumon, "-fn", dmenufont, "-nb", normbgcolor, "-nf", normfgcolor, "-sb", selbordercolor, "-sf", selfgcolor, NULL };
-static const char *termcmd[]  = { "tabbed_st", NULL };
+/* tabbed around st, -n names its window for the pool below */
+static const char *termcmd[]  = { "tabbed", "-c", "-n", "dwmpool-term", "-r", "2", "st", "-w", "", NULL };
 static const char *filemanager[]  = { "thunar", NULL };
 static const char *browser[]  = { "firefox", NULL };
 static const char *layoutmenu_cmd = "layoutmenu.sh";
 
+/* windows started ahead of time and kept hidden until poolclaim or
+ * poolscratchpad shows one of them, the command has to give its windows the
+ * instance name of its pool */
+static const Pool pools[] = {
+	/* instance        command   size */
+	{ "dwmpool-term",  termcmd,  1 },
+	{ NULL } /* terminate */
+};
+
 static const char *applaunchercmd[] = { "mcdmsc-applauncher", NULL };
 static const char *powermenu[] = { "mcdmsc-powermenu", NULL };
 
@@ -255,6 +271,27 @@ static const StatusCmd statuscmds[] = {
 };
 static const char *statuscmd[] = { "/bin/sh", "-c", NULL, NULL };
 
+/* built-in status blocks, shown after the root window name like IPC blocks */
+static const int statusengine = 0; /* 1 means dwm updates the blocks below itself */
+#include "statusblocks.c"
+static const BuiltinBlock statusblocks[] = {
+	/* name       function      argument          format          interval  statuscmd id */
+	{ "cpu",      blk_cpu,      NULL,             " CPU %s%% ",   2,        0 },
+	{ "mem",      blk_mem,      NULL,             " MEM %s%% ",   5,        0 },
+	{ "load",     blk_load,     NULL,             " %s ",         5,        0 },
+	{ "net",      blk_net,      "wlan0",          " %s ",         2,        0 },
+	{ "battery",  blk_battery,  "BAT0",           " BAT %s%% ",   30,       0 },
+	{ "clock",    blk_clock,    "%a %d %b %H:%M", " %s ",         60,       1 },
+};
+
+/* started after the autostart scripts, which run first if they exist */
+static const Autostart autostart[] = {
+	/* command                       restart  barrier */
+	//{ "xrdb -merge ~/.Xresources",    0,       1 }, // later entries wait until it exited
+	//{ "picom",                        1,       0 }, // started again whenever it exits
+	{ NULL } /* terminate */
+};
+
 static Key keys[] = {
 	/* modifier                      key        function        argument */
   // Layouts
@@ -296,7 +333,8 @@ static Key keys[] = {
   // Launchers
 	{ MODKEY,                        XK_space,  rundmenu,       {.v = "mcdmsc-applauncher" } },
 	{ MODKEY|ControlMask,            XK_space,  rundmenu,       {.v = "dwm-dmenu_run" } },
-	{ MODKEY|ControlMask,            XK_Return, spawn,          {.v = termcmd } },
+	{ MODKEY|ControlMask,            XK_Return, poolclaim,      {.v = termcmd } },
+	{ MODKEY|ShiftMask,              XK_Return, poolscratchpad, {.v = termcmd } },
 	{ MODKEY|ControlMask,            XK_f,      spawn,          {.v = filemanager } },
 	{ MODKEY|ControlMask,            XK_b,      spawn,          {.v = browser } },
   // Volume
@@ -389,12 +427,35 @@ static Button buttons[] = {
 
 
 /*
- * SIGNALS
+ * IPC
  */
 
-/* signum must be greater than 0 */
-/* trigger signals using `xsetroot -name "fsignal:<signum>"` */
-static Signal signals[] = {
-	/* signum       function        argument  */
-	{ 1,            setlayout,      {.v = 0} },
+/* commands accepted on $XDG_RUNTIME_DIR/dwm-$DISPLAY.sock, e.g. `dwmc viewex 2`;
+ * the argument is optional, 'argument' is used without one. The swallow
+ * operations swalreg, swal, swalunreg and swalstop are always available. */
+static const IPCCommand ipccommands[] = {
+	/* name             function          type       argument */
+	{ "view",           view,             IPCUint,   {0} },
+	{ "viewex",         viewex,           IPCUint,   {0} },
+	{ "viewall",        viewall,          IPCNone,   {0} },
+	{ "toggleviewex",   toggleviewex,     IPCUint,   {0} },
+	{ "tagex",          tagex,            IPCUint,   {0} },
+	{ "toggletagex",    toggletagex,      IPCUint,   {0} },
+	{ "tagall",         tagall,           IPCNone,   {0} },
+	{ "setlayout",      setlayout,        IPCNone,   {.v = 0} },
+	{ "setlayoutex",    setlayoutex,      IPCInt,    {0} },
+	{ "togglebar",      togglebar,        IPCNone,   {0} },
+	{ "togglefloating", togglefloating,   IPCNone,   {0} },
+	{ "zoom",           zoom,             IPCNone,   {0} },
+	{ "killclient",     killclient,       IPCNone,   {0} },
+	{ "focusstack",     focusstack,       IPCInt,    {.i = +1} },
+	{ "incnmaster",     incnmaster,       IPCInt,    {.i = +1} },
+	{ "setmfact",       setmfact,         IPCFloat,  {.f = 0.05} },
+	{ "focusmon",       focusmon,         IPCInt,    {.i = +1} },
+	{ "tagmon",         tagmon,           IPCInt,    {.i = +1} },
+	{ "quit",           quit,             IPCInt,    {.i = 0} },
 };
+
+/* 1 means the window manager state is kept in shared memory for bars and
+ * scripts, see dwmstate.h */
+static const int sharedstate = 1;
@@ -3,14 +3,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <X11/Xlib.h>
+#include <stdint.h>
 #include <X11/Xft/Xft.h>
-#include <Imlib2.h>
 
 #include "drw.h"
 #include "util.h"
+#include "worker.h"
 
 #define UTF_INVALID 0xFFFD
 #define UTF_SIZ     4
+#define LENGTH(X)   (sizeof (X) / sizeof (X)[0])
 
 static const unsigned char utfbyte[UTF_SIZ + 1] = {0x80,    0, 0xC0, 0xE0, 0xF0};
 static const unsigned char utfmask[UTF_SIZ + 1] = {0xC0, 0x80, 0xE0, 0xF0, 0xF8};
@@ -88,6 +90,7 @@ drw_resize(Drw *drw, unsigned int w, unsigned int h)
 	if (!drw)
 		return;
 
+	drw_flush(drw);
 	drw->w = w;
 	drw->h = h;
 	if (drw->picture)
@@ -101,6 +104,12 @@ drw_resize(Drw *drw, unsigned int w, unsigned int h)
 void
 drw_free(Drw *drw)
 {
+	unsigned int i;
+
+	for (i = 0; i < CLRCACHE; i++)
+		if (drw->clrs[i].state)
+			XftColorFree(drw->dpy, drw->visual, drw->cmap, &drw->clrs[i].clr);
+	drw_setbatch(drw, 0);
 	XRenderFreePicture(drw->dpy, drw->picture);
 	XFreePixmap(drw->dpy, drw->drawable);
 	XFreeGC(drw->dpy, drw->gc);
@@ -202,17 +211,130 @@ drw_fontset_free(Fnt *font)
 	}
 }
 
-void
-drw_clr_create(Drw *drw, Clr *dest, const char *clrname, unsigned int alpha)
+static unsigned int
+clr_hash(unsigned int rgba)
+{
+	return (rgba * 2654435761U) >> 16 & (CLRCACHE - 1);
+}
+
+static int
+clr_parsehex(const char *clrname, unsigned int *rgb)
+{
+	unsigned int i, c, v = 0;
+
+	if (clrname[0] != '#')
+		return 0;
+	for (i = 1; i <= 6; i++) {
+		c = (unsigned char)clrname[i];
+		if (c >= '0' && c <= '9')
+			v = v << 4 | (c - '0');
+		else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+			v = v << 4 | ((c | 0x20) - 'a' + 10);
+		else
+			return 0;
+	}
+	if (clrname[i])
+		return 0;
+	*rgb = v;
+	return 1;
+}
+
+/* Returns the slot holding 'rgba' or the free slot it would be stored in. */
+static ClrSlot *
+clr_lookup(Drw *drw, unsigned int rgba)
 {
+	unsigned int i, h = clr_hash(rgba);
+	ClrSlot *slot;
+
+	for (i = 0; i < CLRCACHE; i++) {
+		slot = &drw->clrs[(h + i) & (CLRCACHE - 1)];
+		if (!slot->state || slot->rgba == rgba)
+			return slot;
+	}
+	return NULL;
+}
+
+/* Drops every colour which is not pinned by a color scheme and rehashes the
+ * remaining ones, so status text cycling through colours cannot grow the
+ * cache (nor the colormap) without bounds. */
+static void
+clr_trim(Drw *drw)
+{
+	ClrSlot pinned[CLRCACHE], *slot;
+	unsigned int i, n = 0;
+
+	for (i = 0; i < CLRCACHE; i++) {
+		slot = &drw->clrs[i];
+		if (slot->state == 2)
+			pinned[n++] = *slot;
+		else if (slot->state)
+			XftColorFree(drw->dpy, drw->visual, drw->cmap, &slot->clr);
+	}
+	memset(drw->clrs, 0, sizeof(drw->clrs));
+	for (i = 0; i < n; i++)
+		*clr_lookup(drw, pinned[i].rgba) = pinned[i];
+	drw->nclrs = n;
+}
+
+static void
+clr_intern(Drw *drw, Clr *dest, const char *clrname, unsigned int alpha, int pin)
+{
+	XRenderColor rc;
+	ClrSlot *slot;
+	Clr clr;
+	unsigned int rgb, rgba;
+
 	if (!drw || !dest || !clrname)
 		return;
 
-	if (!XftColorAllocName(drw->dpy, drw->visual, drw->cmap,
-	                       clrname, dest))
-		die("error, cannot allocate color '%s'", clrname);
+	alpha &= 0xff;
+	if (drw->nclrs >= CLRCACHE / 4 * 3)
+		clr_trim(drw);
+
+	if (clr_parsehex(clrname, &rgb)) {
+		/* the common case: no colour name lookup, no allocation */
+		rgba = alpha << 24 | rgb;
+		if ((slot = clr_lookup(drw, rgba)) && slot->state)
+			goto hit;
+		/* same scaling XParseColor applies to #rrggbb */
+		rc.red   = (rgb >> 16 & 0xff) << 8;
+		rc.green = (rgb >> 8 & 0xff) << 8;
+		rc.blue  = (rgb & 0xff) << 8;
+		rc.alpha = 0xffff;
+		if (!XftColorAllocValue(drw->dpy, drw->visual, drw->cmap, &rc, &clr))
+			die("error, cannot allocate color '%s'", clrname);
+	} else {
+		if (!XftColorAllocName(drw->dpy, drw->visual, drw->cmap,
+		                       clrname, &clr))
+			die("error, cannot allocate color '%s'", clrname);
+		rgba = alpha << 24 | (clr.color.red >> 8) << 16
+		     | (clr.color.green >> 8) << 8 | clr.color.blue >> 8;
+		if ((slot = clr_lookup(drw, rgba)) && slot->state) {
+			XftColorFree(drw->dpy, drw->visual, drw->cmap, &clr);
+			goto hit;
+		}
+	}
 
-	dest->pixel = (dest->pixel & 0x00ffffffU) | (alpha << 24);
+	clr.pixel = (clr.pixel & 0x00ffffffU) | (alpha << 24);
+	*dest = clr;
+	if (!slot)
+		return;
+	slot->rgba = rgba;
+	slot->state = pin ? 2 : 1;
+	slot->clr = clr;
+	drw->nclrs++;
+	return;
+
+hit:
+	if (pin)
+		slot->state = 2;
+	*dest = slot->clr;
+}
+
+void
+drw_clr_create(Drw *drw, Clr *dest, const char *clrname, unsigned int alpha)
+{
+	clr_intern(drw, dest, clrname, alpha, 0);
 }
 
 /* Wrapper to create color schemes. The caller has to call free(3) on the
@@ -227,8 +349,9 @@ drw_scm_create(Drw *drw, char *clrnames[], const unsigned int alphas[], size_t c
 	if (!drw || !clrnames || clrcount < 2 || !(ret = ecalloc(clrcount, sizeof(XftColor))))
 		return NULL;
 
+	/* scheme colours live as long as dwm, keep them out of clr_trim() */
 	for (i = 0; i < clrcount; i++)
-		drw_clr_create(drw, &ret[i], clrnames[i], alphas[i]);
+		clr_intern(drw, &ret[i], clrnames[i], alphas[i], 1);
 	return ret;
 }
 
@@ -246,95 +369,453 @@ drw_setscheme(Drw *drw, Clr *scm)
 		drw->scheme = scm;
 }
 
+/* Redirect drw_rect() and drw_text() to another drawable of the same depth,
+ * returns the previous one. drw_pic() always targets the drw's own pixmap. */
+Drawable
+drw_settarget(Drw *drw, Drawable d)
+{
+	Drawable prev;
+
+	if (!drw)
+		return None;
+	drw_flush(drw);
+	prev = drw->drawable;
+	drw->drawable = d;
+	return prev;
+}
+
+/* With batching enabled drw_text() and drw_rect() only queue what they
+ * would draw: glyphs as positioned XftGlyphFontSpecs, rectangles as
+ * XRectangles, both grouped by colour. drw_flush() then draws each colour
+ * with one XFillRectangles() and one XftDrawGlyphFontSpec() call. Xft
+ * already keeps every glyph it rendered in server side GlyphSets, so this
+ * is only about the number of requests. Order is preserved by flushing
+ * before anything is drawn over queued content of another colour, and
+ * before the drawable is copied or changed. */
+void
+drw_setbatch(Drw *drw, int enable)
+{
+	if (!drw || !enable == !drw->batch)
+		return;
+	if (enable) {
+		drw->batch = ecalloc(1, sizeof(Batch));
+		return;
+	}
+	drw_flush(drw);
+	if (drw->batch->draw)
+		XftDrawDestroy(drw->batch->draw);
+	free(drw->batch);
+	drw->batch = NULL;
+}
+
+static void
+flush_rects(Drw *drw)
+{
+	Batch *b = drw->batch;
+	XRectangle rects[RECTBATCH];
+	int i, j, n;
+
+	for (i = 0; i < b->npixels; i++) {
+		for (j = n = 0; j < b->nrects; j++)
+			if (b->rclr[j] == i)
+				rects[n++] = b->rects[j];
+		XSetForeground(drw->dpy, drw->gc, b->pixels[i]);
+		XFillRectangles(drw->dpy, drw->drawable, drw->gc, rects, n);
+	}
+	b->nrects = b->npixels = 0;
+}
+
+static void
+flush_text(Drw *drw)
+{
+	Batch *b = drw->batch;
+	XftGlyphFontSpec specs[TEXTBATCH];
+	int i, j, n;
+
+	if (!b->draw)
+		b->draw = XftDrawCreate(drw->dpy, drw->drawable, drw->visual, drw->cmap);
+	else if (XftDrawDrawable(b->draw) != drw->drawable)
+		XftDrawChange(b->draw, drw->drawable);
+	for (i = 0; i < b->nclrs; i++) {
+		for (j = n = 0; j < b->nspecs; j++)
+			if (b->clr[j] == i)
+				specs[n++] = b->specs[j];
+		XftDrawGlyphFontSpec(b->draw, &b->clrs[i], specs, n);
+	}
+	b->nspecs = b->nclrs = 0;
+}
+
+void
+drw_flush(Drw *drw)
+{
+	if (!drw || !drw->batch)
+		return;
+	/* text is always queued on top of the rects it overlaps */
+	if (drw->batch->nrects)
+		flush_rects(drw);
+	if (drw->batch->nspecs)
+		flush_text(drw);
+}
+
+static int
+box_hit(Box *box, int x, int y, unsigned int w, unsigned int h)
+{
+	return x < box->x2 && x + (int)w > box->x1 && y < box->y2 && y + (int)h > box->y1;
+}
+
+static void
+box_add(Box *box, int empty, int x, int y, unsigned int w, unsigned int h)
+{
+	if (empty) {
+		box->x1 = x;
+		box->y1 = y;
+		box->x2 = x + w;
+		box->y2 = y + h;
+	} else {
+		box->x1 = MIN(box->x1, x);
+		box->y1 = MIN(box->y1, y);
+		box->x2 = MAX(box->x2, x + (int)w);
+		box->y2 = MAX(box->y2, y + (int)h);
+	}
+}
+
+/* flush whatever is queued below the given area, except rectangles of
+ * colour 'pixel' which may be drawn in any order among themselves */
+static void
+batch_clip(Drw *drw, int x, int y, unsigned int w, unsigned int h, int rect, unsigned long pixel)
+{
+	Batch *b = drw->batch;
+	int i;
+
+	if (!b)
+		return;
+	if (b->nspecs && box_hit(&b->tbox, x, y, w, h)) {
+		drw_flush(drw);
+		return;
+	}
+	for (i = 0; i < b->npixels; i++) {
+		if (rect && b->pixels[i] == pixel)
+			continue;
+		if (box_hit(&b->rbox[i], x, y, w, h)) {
+			flush_rects(drw);
+			break;
+		}
+	}
+}
+
+static void
+batch_rect(Drw *drw, unsigned long pixel, int x, int y, unsigned int w, unsigned int h)
+{
+	Batch *b = drw->batch;
+	int c, fresh;
+
+	if (!w || !h)
+		return;
+	batch_clip(drw, x, y, w, h, 1, pixel);
+	for (c = 0; c < b->npixels; c++)
+		if (b->pixels[c] == pixel)
+			break;
+	if (c == LENGTH(b->pixels) || b->nrects == RECTBATCH) {
+		flush_rects(drw);
+		c = 0;
+	}
+	if ((fresh = c == b->npixels))
+		b->pixels[b->npixels++] = pixel;
+	box_add(&b->rbox[c], fresh, x, y, w, h);
+	b->rects[b->nrects].x = x;
+	b->rects[b->nrects].y = y;
+	b->rects[b->nrects].width = w;
+	b->rects[b->nrects].height = h;
+	b->rclr[b->nrects++] = c;
+}
+
+static void
+batch_text(Drw *drw, Fnt *font, Clr *clr, int x, int y, unsigned int w, unsigned int h,
+	int tx, int ty, const char *text, size_t len)
+{
+	Batch *b = drw->batch;
+	XGlyphInfo ext;
+	FT_UInt glyph;
+	size_t i;
+	long cp;
+	int c;
+
+	for (c = 0; c < b->nclrs; c++)
+		if (!memcmp(&b->clrs[c], clr, sizeof(Clr)))
+			break;
+	if (c == LENGTH(b->clrs) || b->nspecs + len > TEXTBATCH) {
+		/* the rects queued so far may lie under the text */
+		drw_flush(drw);
+		c = 0;
+	}
+	if (c == b->nclrs)
+		b->clrs[b->nclrs++] = *clr;
+	box_add(&b->tbox, !b->nspecs, x, y, w, h);
+	for (i = 0; i < len && b->nspecs < TEXTBATCH;) {
+		i += utf8decode(text + i, &cp, UTF_SIZ);
+		glyph = XftCharIndex(drw->dpy, font->xfont, cp);
+		XftGlyphExtents(drw->dpy, font->xfont, &glyph, 1, &ext);
+		b->specs[b->nspecs].font = font->xfont;
+		b->specs[b->nspecs].glyph = glyph;
+		b->specs[b->nspecs].x = tx;
+		b->specs[b->nspecs].y = ty;
+		b->clr[b->nspecs++] = c;
+		tx += ext.xOff;
+	}
+}
+
+#include "iconscale.c"
+
+/* Premultiplies straight alpha ARGB32 pixels in place and scales them to
+ * 'dstw' x 'dsth'. Returns 'px' if no scaling was needed, else a buffer the
+ * caller has to free. Touches no display state, safe on any thread. */
+uint32_t *
+drw_picture_scale(uint32_t *px, unsigned int srcw, unsigned int srch, unsigned int dstw, unsigned int dsth)
+{
+	uint32_t *scaled;
+
+	premultiply(px, (size_t)srcw * srch);
+	if (srcw == dstw && srch == dsth)
+		return px;
+	scaled = ecalloc((size_t)dstw * dsth, sizeof(uint32_t));
+	resample(px, srcw, srch, scaled, dstw, dsth);
+	return scaled;
+}
+
+/* Uploads premultiplied ARGB32 pixels as they are. The picture holds the
+ * final pixels, no transform or filter is left for the server to apply on
+ * each composite. */
 Picture
-drw_picture_create_resized(Drw *drw, char *src, unsigned int srcw, unsigned int srch, unsigned int dstw, unsigned int dsth) {
+drw_picture_create(Drw *drw, uint32_t *px, unsigned int w, unsigned int h)
+{
 	Pixmap pm;
 	Picture pic;
 	GC gc;
 
-	if (srcw <= (dstw << 1u) && srch <= (dsth << 1u)) {
-		XImage img = {
-			srcw, srch, 0, ZPixmap, src,
-			ImageByteOrder(drw->dpy), BitmapUnit(drw->dpy), BitmapBitOrder(drw->dpy), 32,
-			32, 0, 32,
-			0, 0, 0
-		};
-		XInitImage(&img);
-
-		pm = XCreatePixmap(drw->dpy, drw->root, srcw, srch, 32);
-		gc = XCreateGC(drw->dpy, pm, 0, NULL);
-		XPutImage(drw->dpy, pm, gc, &img, 0, 0, 0, 0, srcw, srch);
-		XFreeGC(drw->dpy, gc);
-
-		pic = XRenderCreatePicture(drw->dpy, pm, XRenderFindStandardFormat(drw->dpy, PictStandardARGB32), 0, NULL);
-		XFreePixmap(drw->dpy, pm);
-
-		XRenderSetPictureFilter(drw->dpy, pic, FilterBilinear, NULL, 0);
-		XTransform xf;
-		xf.matrix[0][0] = (srcw << 16u) / dstw; xf.matrix[0][1] = 0; xf.matrix[0][2] = 0;
-		xf.matrix[1][0] = 0; xf.matrix[1][1] = (srch << 16u) / dsth; xf.matrix[1][2] = 0;
-		xf.matrix[2][0] = 0; xf.matrix[2][1] = 0; xf.matrix[2][2] = 65536;
-		XRenderSetPictureTransform(drw->dpy, pic, &xf);
-	} else {
-		Imlib_Image origin = imlib_create_image_using_data(srcw, srch, (DATA32 *)src);
-		if (!origin) return None;
-		imlib_context_set_image(origin);
-		imlib_image_set_has_alpha(1);
-		Imlib_Image scaled = imlib_create_cropped_scaled_image(0, 0, srcw, srch, dstw, dsth);
-		imlib_free_image_and_decache();
-		if (!scaled) return None;
-		imlib_context_set_image(scaled);
-		imlib_image_set_has_alpha(1);
-
-		XImage img = {
-		    dstw, dsth, 0, ZPixmap, (char *)imlib_image_get_data_for_reading_only(),
-		    ImageByteOrder(drw->dpy), BitmapUnit(drw->dpy), BitmapBitOrder(drw->dpy), 32,
-		    32, 0, 32,
-		    0, 0, 0
-		};
-		XInitImage(&img);
-
-		pm = XCreatePixmap(drw->dpy, drw->root, dstw, dsth, 32);
-		gc = XCreateGC(drw->dpy, pm, 0, NULL);
-		XPutImage(drw->dpy, pm, gc, &img, 0, 0, 0, 0, dstw, dsth);
-		imlib_free_image_and_decache();
-		XFreeGC(drw->dpy, gc);
-
-		pic = XRenderCreatePicture(drw->dpy, pm, XRenderFindStandardFormat(drw->dpy, PictStandardARGB32), 0, NULL);
-		XFreePixmap(drw->dpy, pm);
-	}
+	XImage img = {
+		w, h, 0, ZPixmap, (char *)px,
+		ImageByteOrder(drw->dpy), BitmapUnit(drw->dpy), BitmapBitOrder(drw->dpy), 32,
+		32, 0, 32,
+		0, 0, 0
+	};
+	XInitImage(&img);
+
+	pm = XCreatePixmap(drw->dpy, drw->root, w, h, 32);
+	gc = XCreateGC(drw->dpy, pm, 0, NULL);
+	XPutImage(drw->dpy, pm, gc, &img, 0, 0, 0, 0, w, h);
+	XFreeGC(drw->dpy, gc);
+
+	pic = XRenderCreatePicture(drw->dpy, pm, XRenderFindStandardFormat(drw->dpy, PictStandardARGB32), 0, NULL);
+	XFreePixmap(drw->dpy, pm);
 
 	return pic;
 }
 
+/* Creates a Picture of 'dstw' x 'dsth' from straight alpha ARGB32 pixels,
+ * which are premultiplied in place. */
+Picture
+drw_picture_create_resized(Drw *drw, char *src, unsigned int srcw, unsigned int srch, unsigned int dstw, unsigned int dsth) {
+	uint32_t *px = drw_picture_scale((uint32_t *)src, srcw, srch, dstw, dsth);
+	Picture pic = drw_picture_create(drw, px, dstw, dsth);
+
+	if (px != (uint32_t *)src)
+		free(px);
+	return pic;
+}
+
 void
 drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int invert)
 {
+	unsigned long pixel;
+
 	if (!drw || !drw->scheme)
 		return;
-	XSetForeground(drw->dpy, drw->gc, invert ? drw->scheme[ColBg].pixel : drw->scheme[ColFg].pixel);
+	pixel = invert ? drw->scheme[ColBg].pixel : drw->scheme[ColFg].pixel;
+	if (drw->batch) {
+		if (filled) {
+			batch_rect(drw, pixel, x, y, w, h);
+		} else {
+			batch_rect(drw, pixel, x, y, w, 1);
+			batch_rect(drw, pixel, x, y + h - 1, w, 1);
+			if (h > 2) {
+				batch_rect(drw, pixel, x, y + 1, 1, h - 2);
+				batch_rect(drw, pixel, x + w - 1, y + 1, 1, h - 2);
+			}
+		}
+		return;
+	}
+	XSetForeground(drw->dpy, drw->gc, pixel);
 	if (filled)
 		XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
 	else
 		XDrawRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w - 1, h - 1);
 }
 
+typedef struct {
+	Job job;
+	Drw *drw;
+	long codepoint;
+	FcPattern *pattern;
+	FcPattern *match;
+} FontJob;
+
+static void
+fontjob_run(Job *job)
+{
+	FontJob *j = (FontJob *)job;
+	FcResult result;
+
+	j->match = FcFontMatch(NULL, j->pattern, &result);
+}
+
+/* Adds the matched font to the set if it has the codepoint, otherwise
+ * remembers that there is none so it is not looked up again. */
+static Fnt *
+fontjob_finish(FontJob *j)
+{
+	Drw *drw = j->drw;
+	Fnt *font = NULL, *cur;
+
+	/* another lookup may have added a font covering it meanwhile */
+	for (cur = drw->fonts; cur; cur = cur->next)
+		if (XftCharExists(drw->dpy, cur->xfont, j->codepoint)) {
+			if (j->match)
+				FcPatternDestroy(j->match);
+			FcPatternDestroy(j->pattern);
+			free(j);
+			return cur;
+		}
+	if (j->match) {
+		font = xfont_create(drw, NULL, j->match);
+		if (font && XftCharExists(drw->dpy, font->xfont, j->codepoint)) {
+			for (cur = drw->fonts; cur->next; cur = cur->next)
+				; /* NOP */
+			cur->next = font;
+		} else {
+			xfont_free(font);
+			font = NULL;
+		}
+	}
+	if (!font)
+		drw->fbnone[drw->nfbnone++ % LENGTH(drw->fbnone)] = j->codepoint;
+	FcPatternDestroy(j->pattern);
+	free(j);
+	return font;
+}
+
+static void
+fontjob_done(Job *job)
+{
+	FontJob *j = (FontJob *)job;
+	Drw *drw = j->drw;
+	unsigned int i;
+
+	for (i = 0; i < drw->nfbwait && drw->fbwait[i] != j->codepoint; i++);
+	if (i < drw->nfbwait)
+		drw->fbwait[i] = drw->fbwait[--drw->nfbwait];
+	if (fontjob_finish(j) && drw->fontsready)
+		drw->fontsready(drw);
+}
+
+/* Looks for a font covering 'codepoint'. The match itself, which is by far
+ * the slowest part, is left to the worker thread when there is one; NULL
+ * is returned meanwhile and the caller draws a placeholder glyph. */
+static Fnt *
+fallbackfont(Drw *drw, long codepoint)
+{
+	FcCharSet *fccharset;
+	FcPattern *fcpattern;
+	FontJob *j;
+	unsigned int i;
+
+	for (i = 0; i < drw->nfbwait; i++)
+		if (drw->fbwait[i] == codepoint)
+			return NULL;
+	for (i = 0; i < MIN(drw->nfbnone, LENGTH(drw->fbnone)); i++)
+		if (drw->fbnone[i] == codepoint)
+			return NULL;
+
+	if (!drw->fonts->pattern) {
+		/* Refer to the comment in xfont_create for more information. */
+		die("the first font in the cache must be loaded from a font string.");
+	}
+
+	fccharset = FcCharSetCreate();
+	FcCharSetAddChar(fccharset, codepoint);
+
+	fcpattern = FcPatternDuplicate(drw->fonts->pattern);
+	FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
+	FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
+	FcPatternAddBool(fcpattern, FC_COLOR, FcFalse);
+
+	FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
+	FcDefaultSubstitute(fcpattern);
+	XftDefaultSubstitute(drw->dpy, drw->screen, fcpattern);
+	FcCharSetDestroy(fccharset);
+
+	j = ecalloc(1, sizeof(FontJob));
+	j->job.run = fontjob_run;
+	j->job.done = fontjob_done;
+	j->drw = drw;
+	j->codepoint = codepoint;
+	j->pattern = fcpattern;
+	if (drw->nfbwait < LENGTH(drw->fbwait) && worker_submit(&j->job)) {
+		drw->fbwait[drw->nfbwait++] = codepoint;
+		return NULL;
+	}
+	fontjob_run(&j->job);
+	return fontjob_finish(j);
+}
+
+/* Returns how many bytes of 'text' fit into 'w' pixels followed by an
+ * ellipsis, cut at a codepoint boundary. The glyph advances are measured
+ * once and the cut point is found by bisecting their prefix sums. 'ew' is
+ * set to the resulting width, ellipsis included. */
+static size_t
+text_fit(Fnt *font, const char *text, size_t len, unsigned int w, unsigned int *ew)
+{
+	size_t off[1024], i, n, lo, hi, mid;
+	unsigned int sum[1024], dotsw = 0;
+	long cp;
+	FT_UInt glyph;
+	XGlyphInfo ext;
+
+	drw_font_getexts(font, "...", 3, &dotsw, NULL);
+	if (dotsw > w) {
+		*ew = 0;
+		return 0;
+	}
+	sum[0] = off[0] = 0;
+	for (i = n = 0; i < len && n < LENGTH(sum) - 1; n++) {
+		i += utf8decode(text + i, &cp, UTF_SIZ);
+		glyph = XftCharIndex(font->dpy, font->xfont, cp);
+		XftGlyphExtents(font->dpy, font->xfont, &glyph, 1, &ext);
+		sum[n + 1] = sum[n] + ext.xOff;
+		off[n + 1] = MIN(i, len);
+	}
+	for (lo = 0, hi = n; lo < hi;) {
+		mid = (lo + hi + 1) / 2;
+		if (sum[mid] + dotsw <= w)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	*ew = sum[lo] + dotsw;
+	return off[lo];
+}
+
 int
 drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert)
 {
 	char buf[1024];
-	int ty;
-	unsigned int ew;
+	int ty, bx = 0;
+	unsigned int ew, bw = 0;
 	XftDraw *d = NULL;
 	Fnt *usedfont, *curfont, *nextfont;
-	size_t i, len;
+	size_t len;
 	int utf8strlen, utf8charlen, render = x || y || w || h;
 	long utf8codepoint = 0;
 	const char *utf8str;
-	FcCharSet *fccharset;
-	FcPattern *fcpattern;
-	FcPattern *match;
-	XftResult result;
 	int charexists = 0;
 
 	if (!drw || (render && !drw->scheme) || !text || !drw->fonts)
@@ -343,9 +824,15 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 	if (!render) {
 		w = ~w;
 	} else {
-		XSetForeground(drw->dpy, drw->gc, drw->scheme[invert ? ColFg : ColBg].pixel);
-		XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
-		d = XftDrawCreate(drw->dpy, drw->drawable, drw->visual, drw->cmap);
+		if (drw->batch) {
+			batch_rect(drw, drw->scheme[invert ? ColFg : ColBg].pixel, x, y, w, h);
+		} else {
+			XSetForeground(drw->dpy, drw->gc, drw->scheme[invert ? ColFg : ColBg].pixel);
+			XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
+			d = XftDrawCreate(drw->dpy, drw->drawable, drw->visual, drw->cmap);
+		}
+		bx = x;
+		bw = w;
 		x += lpad;
 		w -= lpad;
 	}
@@ -378,21 +865,34 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 
 		if (utf8strlen) {
 			drw_font_getexts(usedfont, utf8str, utf8strlen, &ew, NULL);
+			len = utf8strlen;
 			/* shorten text if necessary */
-			for (len = MIN(utf8strlen, sizeof(buf) - 1); len && ew > w; len--)
-				drw_font_getexts(usedfont, utf8str, len, &ew, NULL);
+			if (ew > w || len > sizeof(buf) - 1) {
+				/* the cap on buf must not split a UTF-8 sequence */
+				len = MIN(len, sizeof(buf) - 4);
+				while (len && len < utf8strlen && (utf8str[len] & 0xC0) == 0x80)
+					len--;
+				len = text_fit(usedfont, utf8str, len, w, &ew);
+				memcpy(buf, utf8str, len);
+				if (ew) {
+					memcpy(buf + len, "...", 3);
+					len += 3;
+				}
+			} else {
+				memcpy(buf, utf8str, len);
+			}
 
 			if (len) {
-				memcpy(buf, utf8str, len);
 				buf[len] = '\0';
-				if (len < utf8strlen)
-					for (i = len; i && i > len - 3; buf[--i] = '.')
-						; /* NOP */
 
 				if (render) {
 					ty = y + (h - usedfont->h) / 2 + usedfont->xfont->ascent;
-					XftDrawStringUtf8(d, &drw->scheme[invert ? ColBg : ColFg],
-					                  usedfont->xfont, x, ty, (XftChar8 *)buf, len);
+					if (drw->batch)
+						batch_text(drw, usedfont, &drw->scheme[invert ? ColBg : ColFg],
+						           bx, y, bw, h, x, ty, buf, len);
+					else
+						XftDrawStringUtf8(d, &drw->scheme[invert ? ColBg : ColFg],
+						                  usedfont->xfont, x, ty, (XftChar8 *)buf, len);
 				}
 				x += ew;
 				w -= ew;
@@ -408,38 +908,8 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 			/* Regardless of whether or not a fallback font is found, the
 			 * character must be drawn. */
 			charexists = 1;
-
-			fccharset = FcCharSetCreate();
-			FcCharSetAddChar(fccharset, utf8codepoint);
-
-			if (!drw->fonts->pattern) {
-				/* Refer to the comment in xfont_create for more information. */
-				die("the first font in the cache must be loaded from a font string.");
-			}
-
-			fcpattern = FcPatternDuplicate(drw->fonts->pattern);
-			FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
-			FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
-			FcPatternAddBool(fcpattern, FC_COLOR, FcFalse);
-
-			FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
-			FcDefaultSubstitute(fcpattern);
-			match = XftFontMatch(drw->dpy, drw->screen, fcpattern, &result);
-
-			FcCharSetDestroy(fccharset);
-			FcPatternDestroy(fcpattern);
-
-			if (match) {
-				usedfont = xfont_create(drw, NULL, match);
-				if (usedfont && XftCharExists(drw->dpy, usedfont->xfont, utf8codepoint)) {
-					for (curfont = drw->fonts; curfont->next; curfont = curfont->next)
-						; /* NOP */
-					curfont->next = usedfont;
-				} else {
-					xfont_free(usedfont);
-					usedfont = drw->fonts;
-				}
-			}
+			if (!(usedfont = fallbackfont(drw, utf8codepoint)))
+				usedfont = drw->fonts;
 		}
 	}
 	if (d)
@@ -453,19 +923,48 @@ drw_pic(Drw *drw, int x, int y, unsigned int w, unsigned int h, Picture pic)
 {
 	if (!drw)
 		return;
+	batch_clip(drw, x, y, w, h, 0, 0);
 	XRenderComposite(drw->dpy, PictOpOver, pic, None, drw->picture, 0, 0, 0, 0, x, y, w, h);
 }
 
+void
+drw_copy(Drw *drw, Drawable src, int sx, int sy, unsigned int w, unsigned int h, int x, int y)
+{
+	if (!drw)
+		return;
+	batch_clip(drw, x, y, w, h, 0, 0);
+	XCopyArea(drw->dpy, src, drw->drawable, drw->gc, sx, sy, w, h, x, y);
+}
+
 void
 drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h)
 {
 	if (!drw)
 		return;
 
+	drw_flush(drw);
 	XCopyArea(drw->dpy, drw->drawable, win, drw->gc, x, y, w, h, x, y);
 	XSync(drw->dpy, False);
 }
 
+/* Starts looking up fallback fonts for every codepoint of 'text' the set
+ * does not cover yet, so they are loaded before the text is first drawn. */
+void
+drw_fontset_prewarm(Drw *drw, const char *text)
+{
+	Fnt *cur;
+	long cp;
+
+	if (!drw || !drw->fonts || !text)
+		return;
+	while (*text) {
+		text += utf8decode(text, &cp, UTF_SIZ);
+		for (cur = drw->fonts; cur && !XftCharExists(drw->dpy, cur->xfont, cp); cur = cur->next);
+		if (!cur)
+			fallbackfont(drw, cp);
+	}
+}
+
 unsigned int
 drw_fontset_getwidth(Drw *drw, const char *text)
 {
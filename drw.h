@@ -15,7 +15,37 @@ typedef struct Fnt {
 enum { ColFg, ColBg, ColBorder }; /* Clr scheme index */
 typedef XftColor Clr;
 
+#define CLRCACHE 256 /* colour cache slots, must be a power of two */
+
+typedef struct {
+	unsigned int rgba; /* 0xAARRGGBB */
+	int state;         /* 0: free, 1: cached, 2: pinned */
+	Clr clr;
+} ClrSlot;
+
+#define TEXTBATCH 1024 /* glyphs queued before the batch is flushed */
+#define RECTBATCH 512  /* rectangles queued before the batch is flushed */
+
 typedef struct {
+	int x1, y1, x2, y2;
+} Box;
+
+typedef struct {
+	XftGlyphFontSpec specs[TEXTBATCH];
+	unsigned char clr[TEXTBATCH];  /* index into clrs */
+	Clr clrs[16];
+	int nspecs, nclrs;
+	Box tbox;                      /* area covered by the queued text */
+	XRectangle rects[RECTBATCH];
+	unsigned char rclr[RECTBATCH]; /* index into pixels */
+	unsigned long pixels[16];
+	Box rbox[16];                  /* area covered per rect colour */
+	int nrects, npixels;
+	XftDraw *draw;
+} Batch;
+
+typedef struct Drw Drw;
+struct Drw {
 	unsigned int w, h;
 	Display *dpy;
 	int screen;
@@ -28,7 +58,14 @@ typedef struct {
 	GC gc;
 	Clr *scheme;
 	Fnt *fonts;
-} Drw;
+	ClrSlot clrs[CLRCACHE];
+	unsigned int nclrs;
+	Batch *batch;
+	long fbwait[16];  /* codepoints a fallback font is being looked up for */
+	long fbnone[64];  /* codepoints no fallback font was found for */
+	unsigned int nfbwait, nfbnone;
+	void (*fontsready)(Drw *drw); /* a fallback font was added to the set */
+};
 
 /* Drawable abstraction */
 Drw *drw_create(Display *dpy, int screen, Window win, unsigned int w, unsigned int h, Visual *visual, unsigned int depth, Colormap cmap);
@@ -39,6 +76,7 @@ void drw_free(Drw *drw);
 Fnt *drw_fontset_create(Drw* drw, const char *fonts[], size_t fontcount);
 void drw_fontset_free(Fnt* set);
 unsigned int drw_fontset_getwidth(Drw *drw, const char *text);
+void drw_fontset_prewarm(Drw *drw, const char *text);
 void drw_font_getexts(Fnt *font, const char *text, unsigned int len, unsigned int *w, unsigned int *h);
 
 /* Colorscheme abstraction */
@@ -52,13 +90,19 @@ void drw_cur_free(Drw *drw, Cur *cursor);
 /* Drawing context manipulation */
 void drw_setfontset(Drw *drw, Fnt *set);
 void drw_setscheme(Drw *drw, Clr *scm);
+Drawable drw_settarget(Drw *drw, Drawable d);
+void drw_setbatch(Drw *drw, int enable);
+void drw_flush(Drw *drw);
 
+uint32_t *drw_picture_scale(uint32_t *px, unsigned int srcw, unsigned int srch, unsigned int dstw, unsigned int dsth);
+Picture drw_picture_create(Drw *drw, uint32_t *px, unsigned int w, unsigned int h);
 Picture drw_picture_create_resized(Drw *drw, char *src, unsigned int src_w, unsigned int src_h, unsigned int dst_w, unsigned int dst_h);
 
 /* Drawing functions */
 void drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int invert);
 int drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert);
 void drw_pic(Drw *drw, int x, int y, unsigned int w, unsigned int h, Picture pic);
+void drw_copy(Drw *drw, Drawable src, int sx, int sy, unsigned int w, unsigned int h, int x, int y);
 
 /* Map functions */
 void drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h);
@@ -20,18 +20,27 @@
  *
  * To understand everything else, start reading main().
  */
+#define _GNU_SOURCE /* POSIX_SPAWN_SETSID, posix_spawn_file_actions_addclosefrom_np() */
 #include <errno.h>
 #include <locale.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <poll.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
@@ -47,7 +56,10 @@
 #include <time.h>
 
 #include "drw.h"
+#include "dwmstate.h"
+#include "ipc.h"
 #include "util.h"
+#include "worker.h"
 
 /* macros */
 #define BUTTONMASK              (ButtonPressMask|ButtonReleaseMask)
@@ -62,6 +74,7 @@
 #define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
 #define TAGMASK                 ((1 << LENGTH(tags)) - 1)
 #define TEXTW(X)                (drw_fontset_getwidth(drw, (X)) + lrpad)
+#define IPCOUTBUF               16384 /* per client, a subscriber that falls further behind loses events */
 
 #define OPAQUE                  0xffU
 
@@ -88,7 +101,8 @@ enum { CurNormal, CurResize, CurMove, CurSwal, CurLast }; /* cursor */
 enum { SchemeNorm, SchemeSel, SchemeNormMark, SchemeSelMark }; /* color schemes */
 enum { NetSupported, NetSystemTray, NetSystemTrayOP, NetSystemTrayOrientation, NetSystemTrayVisual,
 	   NetWMName, NetWMIcon, NetWMState, NetWMFullscreen, NetActiveWindow, NetWMWindowType, NetWMWindowTypeDock,
-	   NetSystemTrayOrientationHorz, NetWMWindowTypeDialog, NetClientList, NetWMCheck, NetLast }; /* EWMH atoms */
+	   NetSystemTrayOrientationHorz, NetWMWindowTypeDialog, NetClientList, NetWMCheck,
+	   NetClientListStacking, NetNumberOfDesktops, NetCurrentDesktop, NetDesktopNames, NetWMDesktop, NetWMPid, NetLast }; /* EWMH atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast }; /* default atoms */
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle,
        ClkClientWin, ClkRootWin, ClkLast }; /* clicks */
@@ -110,6 +124,53 @@ typedef struct {
 	const Arg arg;
 } Button;
 
+typedef struct Icon Icon;
+struct Icon {
+	uint64_t hash; /* of the source pixels, their size and ICONSIZE */
+	uint32_t *src; /* the source pixels, telling apart icons of equal hash */
+	unsigned int srcw, srch, w, h, refs;
+	unsigned long used; /* last iconclock it was drawn at, for eviction */
+	int pending;        /* being scaled by the worker, pic is None */
+	Picture pic;
+	Icon *next;
+};
+
+typedef struct {
+	Job job;
+	Icon *icon;
+	uint32_t *px, *scaled;
+	unsigned int w, h, dstw, dsth;
+} IconJob;
+
+typedef struct {
+	int fd;
+	short events;
+	void (*func)(int fd, short revents);
+} Watch;
+
+typedef struct {
+	const char *cmd; /* run with sh -c */
+	int restart;     /* start it again whenever it exits */
+	int barrier;     /* later entries wait until it exited */
+} Autostart;
+
+typedef struct {
+	const char *argv[4];
+	int restart, barrier;     /* barrier until its first exit */
+	pid_t pid;                /* 0 if not running */
+	struct timespec started;
+	int quickexits;           /* exits soon after starting, in a row */
+} AutostartJob;
+
+typedef struct Menu Menu;
+struct Menu {
+	int fd;                          /* the menu's standard output */
+	char out[256];
+	size_t len;
+	void (*done)(const char *choice);
+	Menu *next;
+};
+
 typedef struct Monitor Monitor;
 typedef struct Client Client;
 struct Client {
@@ -124,7 +185,13 @@ struct Client {
 	unsigned int tags;
 	int isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen, isfakefullscreen;
 	unsigned int icw, ich; Picture icon;
+	Icon *iconref;
+	int iconstale; /* _NET_WM_ICON not loaded yet or changed since */
+	long netdesk;  /* _NET_WM_DESKTOP as last set, -1 meaning all, -2 not set */
+	unsigned int pool; /* 1 + index into pools while waiting in it, else 0 */
 	int issteam;
+	int isterminal;
+	pid_t pid;     /* _NET_WM_PID, only read for terminals */
 	Client *next;
 	Client *snext;
 	Client *swallowedby;
@@ -139,11 +206,28 @@ typedef struct {
 	const Arg arg;
 } Key;
 
+enum { IPCNone, IPCInt, IPCUint, IPCFloat }; /* IPC argument types */
+enum { IPCEvFocus = 1 << 0, IPCEvTags = 1 << 1, IPCEvLayout = 1 << 2,
+       IPCEvMonitor = 1 << 3, IPCEvClient = 1 << 4, IPCEvTitle = 1 << 5 }; /* IPC events */
+
 typedef struct {
-	unsigned int signum;
+	const char *name;
 	void (*func)(const Arg *);
-	const Arg arg;
-} Signal;
+	int argtype;
+	const Arg arg; /* used when no argument is given */
+} IPCCommand;
+
+typedef struct IPCClient IPCClient;
+struct IPCClient {
+	int fd;
+	int events;             /* IPCEv* subscribed to */
+	char buf[IPCMAXLINE];   /* partial command line */
+	size_t len;
+	char out[IPCOUTBUF];    /* ring of lines not yet sent */
+	size_t outpos, outlen;
+	unsigned long lost;     /* events dropped since the ring filled up */
+	IPCClient *next;
+};
 
 typedef struct {
 	const char *symbol;
@@ -151,6 +235,14 @@ typedef struct {
 } Layout;
 
 typedef struct Pertag Pertag;
+typedef struct {
+	Window sel;
+	unsigned int view, occ, urg;
+	char ltsymbol[16];
+	float mfact;
+	int nmaster;
+} IPCState; /* what subscribers were last told about a monitor */
+
 struct Monitor {
 	char ltsymbol[16];
 	float mfact;
@@ -182,6 +274,7 @@ struct Monitor {
 	Window tabwin;
 	const Layout *lt[2];
 	Pertag *pertag;
+	IPCState ipcstate;
 };
 
 typedef struct {
@@ -193,8 +286,29 @@ typedef struct {
 	int monitor;
 	int floatx, floaty, floatw, floath;
 	int isfakefullscreen;
+	int isterminal;        /* windows started from it swallow it */
+	int noswallow;         /* never swallows a terminal */
 } Rule;
 
+typedef struct {
+	const char *instance;  /* of the windows cmd opens */
+	const char **cmd;
+	unsigned int size;     /* windows kept ready */
+} Pool;
+
+typedef struct {
+	unsigned int pending;  /* started, but no window yet */
+	unsigned int claimed;  /* of those, to be shown right away */
+	unsigned int scratch;  /* of the claimed ones, to be scratchpads */
+	struct timespec since; /* of the last start */
+} PoolState;
+
+typedef struct {
+	pid_t pid, ppid;
+	unsigned long long start; /* of pid, tells a reused pid apart */
+	time_t at;             /* when it was read from /proc */
+} PidCache;
+
 typedef struct Systray Systray;
 struct Systray {
 	Window win;
@@ -206,6 +320,36 @@ typedef struct {
 	int id;
 } StatusCmd;
 
+typedef struct {
+	int x;  /* right edge, relative to the start of its block */
+	int id; /* statuscmd id, i.e. the control byte opening the segment */
+} StatusSeg;
+
+typedef struct {
+	char name[32];          /* "" for the root window name */
+	char text[IPCMAXLINE];
+	int x, w;               /* offset from the first status pixel, width */
+	StatusSeg segs[16];
+	int nsegs;
+} StatusBlock;
+
+typedef struct {
+	int fd[2];                  /* files kept open, -1 if not */
+	unsigned long long last[2]; /* counters at the previous read */
+	struct timespec at;         /* time of the previous read */
+	char buf[64];               /* the text handed back */
+	long next;                  /* CLOCK_MONOTONIC ms the block is due at */
+} BlockState;
+
+typedef struct {
+	const char *name;
+	const char *(*func)(const char *arg, BlockState *st);
+	const char *arg;
+	const char *fmt;       /* printf format with one %s for the text */
+	unsigned int interval; /* seconds */
+	int id;                /* statuscmd id, 0 for none */
+} BuiltinBlock;
+
 typedef struct {
 	int monitor;
 	int tag;
@@ -232,23 +376,28 @@ typedef struct {
 typedef struct Swallow Swallow;
 struct Swallow {
 	/* Window class name, instance name (WM_CLASS) and title
-	 * (WM_NAME/_NET_WM_NAME, latter preferred if it exists). An empty string
-	 * implies a wildcard as per strstr(). */
+	 * (WM_NAME/_NET_WM_NAME, latter preferred if it exists). Class and
+	 * instance have to match exactly, the title is looked for with
+	 * strstr(). An empty string implies a wildcard. */
 	char class[256];
 	char inst[256];
 	char title[256];
 
 	/* Used to delete swallow instance after 'swaldecay' windows were mapped
-	 * without the swallow having been consumed. 'decay' keeps track of the
-	 * remaining "charges". */
-	int decay;
+	 * without the swallow having been consumed. It expires once 'swalmaps'
+	 * reaches 'expires'. */
+	unsigned long expires;
 
 	/* The swallower, i.e. the client which will swallow the next mapped window
 	 * whose filters match the above properties. */
 	Client *client;
 
-	/* Linked list of registered swallow instances. */
+	/* Swallows registered with the same class, see swalbucket(). */
 	Swallow *next;
+
+	/* Neighbours in order of registration, which is also the order in which
+	 * they expire. */
+	Swallow *older, *newer;
 };
 
 /* function declarations */
@@ -260,13 +409,18 @@ static void attach(Client *c);
 static void attachabove(Client *c);
 static void attachaside(Client *c);
 static void attachbelow(Client *c);
+static void attachdirected(Client *c);
 static void attachbottom(Client *c);
 static void attachtop(Client *c);
 static void attachstack(Client *c);
+static void autostartexited(AutostartJob *j, int status);
+static void autostartnext(void);
 static void buttonpress(XEvent *e);
 static void checkotherwm(void);
 static void cleanup(void);
 static void cleanupmon(Monitor *mon);
+static void clientlistadd(Window w);
+static void clientlistdel(Window w);
 static void clientmessage(XEvent *e);
 static void configure(Client *c);
 static void configurenotify(XEvent *e);
@@ -279,31 +433,43 @@ static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
 static void drawbar(Monitor *m);
 static void drawbars(void);
-static int drawstatusbar(Monitor *m, int bh, char* text);
+static void drawstatusbar(Monitor *m, int bh);
+static void drawstatusblock(StatusBlock *b);
+static void drawstatustext(int x, const char *stext);
+static const char *ipcblock(char **argv, size_t argc);
+static void measureblock(StatusBlock *b);
+static int runstatusblocks(void);
+static const char *setstatusblock(const char *name, const char *text);
+static void updateblock(StatusBlock *b, int oldw);
+static int statuscmdat(int x);
 static void enternotify(XEvent *e);
 static void expose(XEvent *e);
-static int fakesignal(void);
 static void focus(Client *c);
 static void focusin(XEvent *e);
 static void focusmon(const Arg *arg);
 static void focusstack(const Arg *arg);
 static Atom getatomprop(Client *c, Atom prop);
-static Picture geticonprop(Window w, unsigned int *icw, unsigned int *ich);
+static Icon *geticonprop(Window w);
 static int getrootptr(int *x, int *y);
+static pid_t getparentprocess(pid_t p, int check);
 static long getstate(Window w);
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
+static pid_t getwinpid(Window w);
 static unsigned int getsystraywidth();
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
 static void incnmaster(const Arg *arg);
 static void keypress(XEvent *e);
-static int fake_signal(void);
 static void killclient(const Arg *arg);
 static void layoutmenu(const Arg *arg);
+static pid_t launch(const char *const argv[], char *const envp[], int out);
+static void layoutchosen(const char *choice);
 static void manage(Window w, XWindowAttributes *wa);
+static void menuread(int fd, short revents);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
 static void monocle(Monitor *m);
+static long msince(const struct timespec *t);
 static void motionnotify(XEvent *e);
 static void movemouse(const Arg *arg);
 static Client *nexttagged(Client *c);
@@ -312,10 +478,16 @@ static Client *nexttiled(Client *c);
 static void pop(Client *);
 static Client *prevtiled(Client *c);
 static unsigned int prevtag(void);
+static void poolclaim(const Arg *arg);
+static int poolfill(void);
+static void poolkill(void);
+static void poolscratchpad(const Arg *arg);
+static void poolshow(const Arg *arg, int scratchpad);
 static void propertynotify(XEvent *e);
 static void pushdown(const Arg *arg);
 static void pushup(const Arg *arg);
 static void quit(const Arg *arg);
+static void reapchildren(int fd, short revents);
 static Monitor *recttomon(int x, int y, int w, int h);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
@@ -323,7 +495,9 @@ static void resizemouse(const Arg *arg);
 static void removesystrayicon(Client *i);
 static void resizerequest(XEvent *e);
 static void restack(Monitor *m);
+static int rulematches(const Rule *r, const char *class, const char *instance, const char *title);
 static void run(void);
+static void runmenu(const char *cmd, void (*done)(const char *choice));
 static void rundmenu(const Arg* arg);
 static void runautostart(void);
 static void scan(void);
@@ -343,9 +517,11 @@ static void setmark(Client *c);
 static void setcfact(const Arg *arg);
 static void setmfact(const Arg *arg);
 static void setup(void);
+static void setupstate(void);
 static void seturgent(Client *c, int urg);
 static void showhide(Client *c);
 static void sigchld(int unused);
+static void stopautostart(void);
 static void sighup(int unused);
 static void sigterm(int unused);
 static void spawn(const Arg *arg);
@@ -353,10 +529,14 @@ static void swapclient(const Arg *arg);
 static void swapfocus(const Arg *arg);
 static void swal(Client *swer, Client *swee, int manage);
 static void swalreg(Client *c, const char* class, const char* inst, const char* title);
-static void swaldecayby(int decayby);
-static void swalmanage(Swallow *s, Window w, XWindowAttributes *wa);
-static Swallow *swalmatch(Window w);
+static Swallow **swalbucket(const char *class);
+static void swalexpire(void);
+static Swallow *swalfind(Client *c);
+static int swalallowed(Window w, const char *class, const char *instance);
+static void swalmanage(Client *swer, Window w, XWindowAttributes *wa);
+static Swallow *swalmatch(Window w, XClassHint *ch);
 static void swalmouse(const Arg *arg);
+static Client *swalterminal(Window w, XClassHint *ch);
 static void swalrm(Swallow *s);
 static void swalunreg(Client *c);
 static void swalstop(Client *c, Client *root);
@@ -371,6 +551,37 @@ static void togglefloating(const Arg *arg);
 static void togglemark(const Arg *arg);
 static void toggletag(const Arg *arg);
 static void toggleview(const Arg *arg);
+static void addwatch(int fd, void (*func)(int fd, short revents));
+static void delwatch(int fd);
+static void setwatch(int fd, short events);
+static void ipcaccept(int fd, short revents);
+static void ipcclose(IPCClient *c);
+static void ipccommand(IPCClient *c, char *line);
+static void ipcemit(IPCClient *to, int event, const char *fmt, ...);
+static void ipcflush(IPCClient *c);
+static void ipcnotify(IPCClient *to);
+static void ipcqueue(IPCClient *c, const char *s, size_t n);
+static void ipcread(int fd, short revents);
+static void ipcsetup(void);
+static void publishstate(void);
+static const char *ipcstats(char **argv, size_t argc, char *out, size_t size);
+static const char *ipcsubscribe(IPCClient *c, char **argv, size_t argc);
+static const char *ipcswallow(char **argv, size_t argc);
+static void ipctitle(Client *c);
+static void ipcwrite(IPCClient *c, const char *s, size_t n);
+static void setlayoutex(const Arg *arg);
+static void tagall(const Arg *arg);
+static void tagex(const Arg *arg);
+static void toggletagex(const Arg *arg);
+static void toggleviewex(const Arg *arg);
+static void viewall(const Arg *arg);
+static void viewex(const Arg *arg);
+static void evicticon(void);
+static void fontsready(Drw *d);
+static void iconjobdone(Job *job);
+static unsigned int iconusers(Icon *icon);
+static void iconjobrun(Job *job);
+static void workerready(int fd, short revents);
 static void freeicon(Client *c);
 static void unfocus(Client *c, int setfocus);
 static void unmanage(Client *c, int destroyed);
@@ -378,6 +589,7 @@ static void unmapnotify(XEvent *e);
 static void updatebarpos(Monitor *m);
 static void updatebars(void);
 static void updateclientlist(void);
+static void updateewmh(void);
 static int updategeom(void);
 static void updatenumlockmask(void);
 static void updatesizehints(Client *c);
@@ -385,10 +597,13 @@ static void updatestatus(void);
 static void updatesystray(int updatebar);
 static void updatesystrayicongeom(Client *i, int w, int h);
 static void updatesystrayiconstate(Client *i, XPropertyEvent *ev);
+static int textw2d(char *text);
+static void updatetagcells(void);
 static void updatetitle(Client *c);
 static void updateicon(Client *c);
 static void updatewindowtype(Client *c);
 static void updatewmhints(Client *c);
+static long usince(const struct timespec *t);
 static void view(const Arg *arg);
 static void viewnext(const Arg *arg);
 static void viewprev(const Arg *arg);
@@ -421,9 +636,12 @@ static const char broken[] = "broken";
 static const char dwmdir[] = "dwm";
 static const char localshare[] = ".local/share";
 static int dmenux, dmenuy, dmenuw;
-static char stext[1024];
-static int statusw;
+static StatusBlock blocks[33]; /* the root window name and named blocks */
+static int nblocks = 1;
+static int statusw;          /* width of the status text */
+static int statusx;          /* bar position of the first status text pixel */
 static int statuscmdn;
+static unsigned int systrayw;
 static char lastbutton[] = "-";
 static int screen;
 static int sw, sh;           /* X display screen geometry width, height */
@@ -460,8 +678,45 @@ static Clr **scheme;
 static Clr **tagscheme;
 static Display *dpy;
 static Drw *drw;
+static Icon *icons;        /* shared by all clients with identical icons */
+static unsigned int nicons;
+static unsigned long iconclock;
+static Watch watches[16]; /* descriptors polled by run() besides the display */
+static int nwatches;
+static int ipcfd = -1;
+static char ipcpath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static IPCClient *ipcclients;
+static Menu *menus;           /* menus waiting for a choice */
+static int sigchldpipe[2] = { -1, -1 }; /* written to by sigchld() */
+static AutostartJob *autostartjobs;
+static size_t nautostartjobs, nautostartstarted;
+static struct timespec starttime; /* of dwm, for the autostart timings */
+static struct {
+	unsigned long count;
+	long last, max;            /* microseconds spent in launch() */
+	long long total;
+} spawnstats;
+static char buttonenv[] = "BUTTON=-";
+static char **statusenv;      /* environ with buttonenv, for statuscmds */
+static int ipcselmon = -1; /* selected monitor subscribers were last told about */
+static const char *ipcevents[] = { "focus", "tags", "layout", "monitor", "client", "title" };
+static DwmState *statemap;   /* published state, see dwmstate.h */
+static DwmState statenext;   /* built and compared with statemap by publishstate() */
+static char statename[64];
+static Window *clientlist;     /* _NET_CLIENT_LIST, in mapping order */
+static size_t nclientlist, clientlistsize;
+static int clientlistdirty;
+static long netcurdesk = -1;   /* _NET_CURRENT_DESKTOP as last set */
+static Window *netstacking;    /* _NET_CLIENT_LIST_STACKING as last set */
+static Window *netstackingnext;
+static size_t nnetstacking, netstackingsize;
 static Monitor *mons, *selmon;
-static Swallow *swallows;
+#define SWALBUCKETS 64 /* must be a power of two */
+static Swallow *swalbuckets[SWALBUCKETS + 1]; /* the last for any class */
+static Swallow *swaloldest, *swalnewest;
+static unsigned long swalmaps; /* windows mapped, for swaldecay */
+static unsigned int nswallows;
+static PidCache pidcache[256]; /* parents of processes, see getparentprocess() */
 static Window root, wmcheckwin;
 static Client *mark;
 
@@ -477,9 +732,15 @@ static Colormap cmap;
 # define SCRATCHPAD_MASK (1u << sizeof tags / sizeof * tags)
 static Client * scratchpad_last_showed = NULL;
 
+/* warm pool, its windows are hidden on a tag of their own */
+#define POOL_MASK               (SCRATCHPAD_MASK << 1)
+
 /* configuration, allows nested code to access above variables */
 #include "config.h"
 
+static BlockState blockstate[LENGTH(statusblocks)];
+static PoolState poolstate[LENGTH(pools)];
+
 struct Pertag {
 	unsigned int curtag, prevtag; /* current and previous tag */
 	int nmasters[LENGTH(tags) + 1]; /* number of windows in master area */
@@ -492,6 +753,11 @@ struct Pertag {
 /* compile-time check if all tags fit into an unsigned int bit array. */
 struct NumTags { char limitexceeded[LENGTH(tags) > 30 ? -1 : 1]; };
 
+/* tag cell sprites, one bh high row per TagCell combination */
+enum { TagCellSel = 1, TagCellUrg = 2, TagCellOcc = 4, TagCellOccSel = 8, TagCellLast = 12 };
+static Pixmap tagcells;
+static unsigned int tagw[LENGTH(tags)], tagx[LENGTH(tags)], tagsw;
+
 /* function implementations */
 static int combo = 0;
 
@@ -550,12 +816,10 @@ applyrules(Client *c)
 
 	for (i = 0; i < LENGTH(rules); i++) {
 		r = &rules[i];
-		if ((!r->title || strstr(c->name, r->title))
-		&& (!r->class || strstr(class, r->class))
-		&& (!r->instance || strstr(instance, r->instance)))
-		{
+		if (rulematches(r, class, instance, c->name)) {
 			c->isfloating = r->isfloating;
 			c->isfakefullscreen = r->isfakefullscreen;
+			c->isterminal = r->isterminal;
 			c->tags |= r->tags;
 			if (r->isfloating) {
 				c->x = r->floatx;
@@ -568,11 +832,28 @@ applyrules(Client *c)
 				c->mon = m;
 		}
 	}
+	for (i = 0; i < LENGTH(pools) && pools[i].instance; i++)
+		if (poolstate[i].pending && !strcmp(instance, pools[i].instance)) {
+			poolstate[i].pending--;
+			/* the windows are alike, the first to map is the claimed one */
+			if (poolstate[i].claimed) {
+				poolstate[i].claimed--;
+				if (poolstate[i].scratch) {
+					poolstate[i].scratch--;
+					c->isfloating = 1;
+					scratchpad_last_showed = c;
+				}
+				break;
+			}
+			c->pool = i + 1;
+			c->tags = POOL_MASK;
+			break;
+		}
 	if (ch.res_class)
 		XFree(ch.res_class);
 	if (ch.res_name)
 		XFree(ch.res_name);
-	if (c->tags != SCRATCHPAD_MASK)
+	if (c->tags != SCRATCHPAD_MASK && !c->pool)
 		c->tags = c->tags & TAGMASK ? c->tags & TAGMASK : c->mon->tagset[c->mon->seltags];
 }
 
@@ -642,6 +923,38 @@ applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
 	return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
 
+void
+addwatch(int fd, void (*func)(int fd, short revents))
+{
+	if (nwatches == LENGTH(watches))
+		die("dwm: too many watched descriptors");
+	watches[nwatches].fd = fd;
+	watches[nwatches].events = POLLIN;
+	watches[nwatches++].func = func;
+}
+
+void
+delwatch(int fd)
+{
+	int i;
+
+	for (i = 0; i < nwatches; i++)
+		if (watches[i].fd == fd) {
+			watches[i] = watches[--nwatches];
+			return;
+		}
+}
+
+void
+setwatch(int fd, short events)
+{
+	int i;
+
+	for (i = 0; i < nwatches; i++)
+		if (watches[i].fd == fd)
+			watches[i].events = events;
+}
+
 void
 arrange(Monitor *m)
 {
@@ -696,6 +1009,31 @@ attachaside(Client *c) {
 	at->next = c;
 }
 
+/* Attaches c where attachdirection puts new windows. */
+void
+attachdirected(Client *c)
+{
+	switch(attachdirection){
+		case 1:
+			attachabove(c);
+			break;
+		case 2:
+			attachaside(c);
+			break;
+		case 3:
+			attachbelow(c);
+			break;
+		case 4:
+			attachbottom(c);
+			break;
+		case 5:
+			attachtop(c);
+			break;
+		default:
+			attach(c);
+	}
+}
+
 void
 attachbelow(Client *c)
 {
@@ -745,6 +1083,58 @@ attachstack(Client *c)
 	c->mon->stack = c;
 }
 
+void
+autostartexited(AutostartJob *j, int status)
+{
+	const char *name = j->argv[2] ? j->argv[2] : j->argv[0];
+	long ran = msince(&j->started);
+
+	j->pid = 0;
+	if (WIFEXITED(status))
+		fprintf(stderr, "dwm: autostart '%s' exited with %d after %ldms\n", name, WEXITSTATUS(status), ran);
+	else
+		fprintf(stderr, "dwm: autostart '%s' killed by signal %d after %ldms\n", name,
+			WIFSIGNALED(status) ? WTERMSIG(status) : 0, ran);
+	if (j->barrier) {
+		/* the entries after it wait for its first exit only */
+		j->barrier = 0;
+		autostartnext();
+	}
+	if (j->restart && running) {
+		/* give up on a command that keeps failing right away */
+		j->quickexits = ran < 5000 ? j->quickexits + 1 : 0;
+		if (j->quickexits == 3) {
+			fprintf(stderr, "dwm: autostart '%s' keeps exiting, not restarted\n", name);
+			return;
+		}
+		if ((j->pid = launch(j->argv, environ, -1)) > 0)
+			clock_gettime(CLOCK_MONOTONIC, &j->started);
+		else
+			j->pid = 0;
+	}
+}
+
+/* Starts the entries up to and including the next barrier which has not
+ * exited yet. */
+void
+autostartnext(void)
+{
+	AutostartJob *j;
+
+	while (nautostartstarted < nautostartjobs) {
+		j = &autostartjobs[nautostartstarted++];
+		if ((j->pid = launch(j->argv, environ, -1)) <= 0) {
+			j->pid = 0;
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &j->started);
+		fprintf(stderr, "dwm: autostart '%s' started at %ldms\n",
+			j->argv[2] ? j->argv[2] : j->argv[0], msince(&starttime));
+		if (j->barrier)
+			break;
+	}
+}
+
 void
 buttonpress(XEvent *e)
 {
@@ -764,7 +1154,7 @@ buttonpress(XEvent *e)
 	if (ev->window == selmon->barwin) {
 		i = x = 0;
 		do
-			x += TEXTW(tags[i]);
+			x += tagw[i];
 		while (ev->x >= x && ++i < LENGTH(tags));
 		if (i < LENGTH(tags)) {
 			click = ClkTagBar;
@@ -772,25 +1162,9 @@ buttonpress(XEvent *e)
 		} else if (ev->x < x + blw)
 			click = ClkLtSymbol;
 		else if (ev->x > selmon->ww - statusw - getsystraywidth()) {
-			char *text, *s, ch;
 			*lastbutton = '0' + ev->button;
-
-			x = selmon->ww - statusw;
 			click = ClkStatusText;
-
-			statuscmdn = 0;
-			for (text = s = stext; *s && x <= ev->x; s++) {
-				if ((unsigned char)(*s) < ' ') {
-					ch = *s;
-					*s = '\0';
-					x += TEXTW(text) - lrpad;
-					*s = ch;
-					text = s + 1;
-					if (x >= ev->x)
-						break;
-					statuscmdn = ch;
-				}
-			}
+			statuscmdn = statuscmdat(ev->x - statusx);
 		}
 		else
 			click = ClkWinTitle;
@@ -846,6 +1220,24 @@ cleanup(void)
 	for (i = 0; i < LENGTH(colors) + 1; i++)
 		free(scheme[i]);
 	XDestroyWindow(dpy, wmcheckwin);
+	while (ipcclients)
+		ipcclose(ipcclients);
+	if (ipcfd != -1) {
+		close(ipcfd);
+		unlink(ipcpath);
+	}
+	if (statemap) {
+		munmap(statemap, sizeof(*statemap));
+		shm_unlink(statename);
+	}
+	for (i = 0; i < LENGTH(blockstate); i++) {
+		if (blockstate[i].fd[0] != -1)
+			close(blockstate[i].fd[0]);
+		if (blockstate[i].fd[1] != -1)
+			close(blockstate[i].fd[1]);
+	}
+	worker_stop();
+	XFreePixmap(dpy, tagcells);
 	drw_free(drw);
 	XSync(dpy, False);
 	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
@@ -868,6 +1260,29 @@ cleanupmon(Monitor *mon)
 	free(mon);
 }
 
+void
+clientlistadd(Window w)
+{
+	if (nclientlist == clientlistsize) {
+		clientlistsize = clientlistsize ? 2 * clientlistsize : 64;
+		clientlist = erealloc(clientlist, clientlistsize * sizeof(Window));
+	}
+	clientlist[nclientlist++] = w;
+	clientlistdirty = 1;
+}
+
+void
+clientlistdel(Window w)
+{
+	size_t i;
+
+	for (i = nclientlist; i > 0 && clientlist[i - 1] != w; i--);
+	if (!i--)
+		return;
+	memmove(clientlist + i, clientlist + i + 1, (--nclientlist - i) * sizeof(Window));
+	clientlistdirty = 1;
+}
+
 void
 clientmessage(XEvent *e)
 {
@@ -914,9 +1329,25 @@ clientmessage(XEvent *e)
 		return;
 	}
 
+	if (cme->window == root && cme->message_type == netatom[NetCurrentDesktop]) {
+		if (cme->data.l[0] >= 0 && cme->data.l[0] < LENGTH(tags)) {
+			Arg a = {.ui = 1 << cme->data.l[0]};
+			view(&a);
+		}
+		return;
+	}
 	if (!c)
 		return;
-	if (cme->message_type == netatom[NetWMState]) {
+	if (cme->message_type == netatom[NetWMDesktop]) {
+		if ((cme->data.l[0] & 0xFFFFFFFF) == 0xFFFFFFFF)
+			c->tags = TAGMASK;
+		else if (cme->data.l[0] >= 0 && cme->data.l[0] < LENGTH(tags))
+			c->tags = 1 << cme->data.l[0];
+		else
+			return;
+		focus(NULL);
+		arrange(c->mon);
+	} else if (cme->message_type == netatom[NetWMState]) {
 		if (cme->data.l[1] == netatom[NetWMFullscreen]
 		|| cme->data.l[2] == netatom[NetWMFullscreen])
 			setfullscreen(c, (cme->data.l[0] == 1 /* _NET_WM_STATE_ADD    */
@@ -1162,8 +1593,9 @@ destroynotify(XEvent *e)
     for (swee = root; swee->swallowedby != c; swee = swee->swallowedby);
     swee->swallowedby = NULL;
 
+    clientlistdel(c->win);
+    freeicon(c);
     free(c);
-    updateclientlist();
   } else if (showsystray && (c = wintosystrayicon(ev->window))) {
 		removesystrayicon(c);
 		updatesystray(1);
@@ -1208,58 +1640,54 @@ dirtomon(int dir)
 	return m;
 }
 
-int
-drawstatusbar(Monitor *m, int bh, char* stext) {
-	int ret, i, j, w, x, len;
-	short isCode = 0;
-	char *text;
-	char *p;
-
-	len = strlen(stext) + 1 ;
-	if (!(text = (char*) malloc(sizeof(char)*len)))
-		die("malloc");
-	p = text;
-
-	i = -1, j = 0;
-	while (stext[++i])
-		if ((unsigned char)stext[i] >= ' ')
-			text[j++] = stext[i];
-	text[j] = '\0';
-
-	/* compute width of the status text */
-	w = 0;
-	i = -1;
-	while (text[++i]) {
-		if (text[i] == '^') {
-			if (!isCode) {
-				isCode = 1;
-				text[i] = '\0';
-				w += TEXTW(text) - lrpad;
-				text[i] = '^';
-				if (text[++i] == 'f')
-					w += atoi(text + ++i);
-			} else {
-				isCode = 0;
-				text = text + i + 1;
-				i = -1;
-			}
-		}
-	}
-	if (!isCode)
-		w += TEXTW(text) - lrpad;
-	else
-		isCode = 0;
-	text = p;
+void
+drawstatusbar(Monitor *m, int bh)
+{
+	StatusBlock *b;
+	int end = m->ww - getsystraywidth();
 
-	w += 2; /* 1px padding on both sides */
-	ret = x = m->ww - w;
-	x = m->ww - w - getsystraywidth();
+	statusx = end - statusw - 1 - 2 * sp; /* 1px padding on both sides */
+	drw_setscheme(drw, scheme[LENGTH(colors)]);
+	drw->scheme[ColFg] = scheme[SchemeNorm][ColFg];
+	drw->scheme[ColBg] = scheme[SchemeNorm][ColBg];
+	drw_rect(drw, statusx - 1, 0, end - statusx + 1, bh, 1, 1);
+	for (b = blocks; b < blocks + nblocks; b++) {
+		drawstatustext(statusx + b->x, b->text);
+		drw->scheme[ColFg] = scheme[SchemeNorm][ColFg];
+		drw->scheme[ColBg] = scheme[SchemeNorm][ColBg];
+	}
+	drw_setscheme(drw, scheme[SchemeNorm]);
+}
 
+/* Redraws a block in place, valid as long as no width changed since the last
+ * drawbar() of the selected monitor. */
+void
+drawstatusblock(StatusBlock *b)
+{
+	if (!selmon->showbar || !b->w)
+		return;
 	drw_setscheme(drw, scheme[LENGTH(colors)]);
 	drw->scheme[ColFg] = scheme[SchemeNorm][ColFg];
 	drw->scheme[ColBg] = scheme[SchemeNorm][ColBg];
-	drw_rect(drw, x, 0, w, bh, 1, 1);
-	x++;
+	drw_rect(drw, statusx + b->x, 0, b->w, bh, 1, 1);
+	drawstatustext(statusx + b->x, b->text);
+	drw_setscheme(drw, scheme[SchemeNorm]);
+	drw_map(drw, selmon->barwin, statusx + b->x, 0, b->w, bh);
+}
+
+/* Draws status text with its status2d codes at x, skipping the statuscmd
+ * control bytes. */
+void
+drawstatustext(int x, const char *stext)
+{
+	char line[IPCMAXLINE], *text = line;
+	int i, w;
+	short isCode = 0;
+
+	for (i = 0; *stext && i < sizeof(line) - 1; stext++)
+		if ((unsigned char)*stext >= ' ')
+			line[i++] = *stext;
+	line[i] = '\0';
 
 	/* process status text */
 	i = -1;
@@ -1269,7 +1697,7 @@ drawstatusbar(Monitor *m, int bh, char* stext) {
 
 			text[i] = '\0';
 			w = TEXTW(text) - lrpad;
-			drw_text(drw, x - 2 * sp, 0, w, bh, 0, text, 0);
+			drw_text(drw, x, 0, w, bh, 0, text, 0);
 
 			x += w;
 
@@ -1313,13 +1741,29 @@ drawstatusbar(Monitor *m, int bh, char* stext) {
 
 	if (!isCode) {
 		w = TEXTW(text) - lrpad;
-		drw_text(drw, x - 2 * sp, 0, w, bh, 0, text, 0);
+		drw_text(drw, x, 0, w, bh, 0, text, 0);
 	}
+}
 
-	drw_setscheme(drw, scheme[SchemeNorm]);
-	free(p);
+/* Binary search of the status segment containing offset 'x'. */
+int
+statuscmdat(int x)
+{
+	StatusBlock *b;
+	int lo = 0, hi, mid;
 
-	return ret;
+	for (b = blocks + nblocks - 1; b > blocks && b->x > x; b--);
+	if ((hi = b->nsegs - 1) < 0)
+		return 0;
+	x -= b->x;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (b->segs[mid].x >= x)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return b->segs[lo].id;
 }
 
 void
@@ -1328,7 +1772,7 @@ drawbar(Monitor *m)
 	int x, w, tw = 0, stw = 0;
 	int boxs = drw->fonts->h / 9;
 	int boxw = drw->fonts->h / 6 + 2;
-	unsigned int i, occ = 0, urg = 0;
+	unsigned int i, cell, occ = 0, urg = 0;
 	Client *c;
 
 	if (!m->showbar)
@@ -1347,7 +1791,8 @@ drawbar(Monitor *m)
 		//tw = TEXTW(stext) - lrpad + 2; // 2px right padding
 		//drw_text(drw, m->ww - tw, 0, tw, bh, 0, stext, 0);
 		//drw_text(drw, m->ww - tw - stw, 0, tw, bh, 0, stext, 0);
-		tw = statusw = m->ww - drawstatusbar(m, bh, stext) - 2;
+		drawstatusbar(m, bh);
+		tw = statusw;
 	}
 
 	for (c = m->clients; c; c = c->next) {
@@ -1355,17 +1800,18 @@ drawbar(Monitor *m)
 		if (c->isurgent)
 			urg |= c->tags;
 	}
-	x = 0;
 	for (i = 0; i < LENGTH(tags); i++) {
-		w = TEXTW(tags[i]);
-		drw_setscheme(drw, (m->tagset[m->seltags] & 1 << i ? tagscheme[i] : scheme[SchemeNorm]));
-		drw_text(drw, x, 0, w, bh, lrpad / 2, tags[i], urg & 1 << i);
+		cell = 0;
+		if (m->tagset[m->seltags] & 1 << i)
+			cell |= TagCellSel;
+		if (urg & 1 << i)
+			cell |= TagCellUrg;
 		if (occ & 1 << i)
-			drw_rect(drw, x + boxs, boxs, boxw, boxw,
-				m == selmon && selmon->sel && selmon->sel->tags & 1 << i,
-				urg & 1 << i);
-		x += w;
+			cell |= m == selmon && selmon->sel && selmon->sel->tags & 1 << i
+				? TagCellOccSel : TagCellOcc;
+		drw_copy(drw, tagcells, tagx[i], cell * bh, tagw[i], bh, tagx[i], 0);
 	}
+	x = tagsw;
 	w = blw = TEXTW(m->ltsymbol);
 	drw_setscheme(drw, scheme[SchemeNorm]);
 	x = drw_text(drw, x, 0, w, bh, lrpad / 2, m->ltsymbol, 0);
@@ -1380,16 +1826,20 @@ drawbar(Monitor *m)
 
 	if ((w = m->ww - tw - stw - x) > bh) {
 		if (m->sel) {
+			if (m->sel->iconstale)
+				updateicon(m->sel);
+			if (m->sel->iconref)
+				m->sel->iconref->used = ++iconclock;
 			drw_setscheme(drw, scheme[m == selmon ? SchemeSel : SchemeNorm]);
 			/*
 			drw_text(drw, x, 0, w - 2 * sp, bh, lrpad / 2, m->sel->name, 0);
 			*/
 			if (TEXTW(m->sel->name) > w) /* title is bigger than the width of the title rectangle, don't center */
 				//drw_text(drw, x, 0, w - 2 * sp, bh, lrpad / 2, m->sel->name, 0);
-  			drw_text(drw, x, 0, w - 2 * sp, bh, lrpad / 2 + (m->sel->icon ? m->sel->icw + ICONSPACING : 0), m->sel->name, 0);
+  			drw_text(drw, x, 0, w - 2 * sp, bh, lrpad / 2 + (m->sel->iconref ? m->sel->icw + ICONSPACING : 0), m->sel->name, 0);
 			else /* center window title */
 				//drw_text(drw, x, 0, w - 2 * sp, bh, (w - TEXTW(m->sel->name)) / 2, m->sel->name, 0);
-  			drw_text(drw, x, 0, w - 2 * sp, bh, (w - TEXTW(m->sel->name)) / 2 + (m->sel->icon ? m->sel->icw + ICONSPACING : 0), m->sel->name, 0);
+  			drw_text(drw, x, 0, w - 2 * sp, bh, (w - TEXTW(m->sel->name)) / 2 + (m->sel->iconref ? m->sel->icw + ICONSPACING : 0), m->sel->name, 0);
 			if (m->sel->icon) drw_pic(drw, x + lrpad / 2, (bh - m->sel->ich) / 2, m->sel->icw, m->sel->ich, m->sel->icon);
 			if (m->sel->isfloating)
 				drw_rect(drw, x + boxs, boxs, boxw, boxw, m->sel->isfixed, 0);
@@ -1447,81 +1897,6 @@ expose(XEvent *e)
 	}
 }
 
-int
-fakesignal(void)
-{
-	/* Command syntax: <PREFIX><COMMAND>[<SEP><ARG>]... */
-	static const char sep[] = "###";
-	static const char prefix[] = "#!";
-
-	size_t numsegments, numargs;
-	char rootname[256];
-	char *segments[16] = {0};
-
-	/* Get root name, split by separator and find the prefix */
-	if (!gettextprop(root, XA_WM_NAME, rootname, sizeof(rootname))
-		|| strncmp(rootname, prefix, sizeof(prefix) - 1)) {
-		return 0;
-	}
-	numsegments = split(rootname + sizeof(prefix) - 1, sep, segments, sizeof(segments));
-	numargs = numsegments - 1; /* number of arguments to COMMAND */
-
-	if (!strcmp(segments[0], "swalreg")) {
-		/* Params: windowid, [class], [instance], [title] */
-		Window w;
-		Client *c;
-
-		if (numargs >= 1) {
-			w = strtoul(segments[1], NULL, 0);
-			switch (wintoclient2(w, &c, NULL)) {
-			case ClientRegular: /* fallthrough */
-			case ClientSwallowee:
-				swalreg(c, segments[2], segments[3], segments[4]);
-				break;
-			}
-		}
-	}
-	else if (!strcmp(segments[0], "swal")) {
-		/* Params: swallower's windowid, swallowee's window-id */
-		Client *swer, *swee;
-		Window winswer, winswee;
-		int typeswer, typeswee;
-
-		if (numargs >= 2) {
-			winswer = strtoul(segments[1], NULL, 0);
-			typeswer = wintoclient2(winswer, &swer, NULL);
-			winswee = strtoul(segments[2], NULL, 0);
-			typeswee = wintoclient2(winswee, &swee, NULL);
-			if ((typeswer == ClientRegular || typeswer == ClientSwallowee)
-				&& (typeswee == ClientRegular || typeswee == ClientSwallowee))
-				swal(swer, swee, 0);
-		}
-	}
-	else if (!strcmp(segments[0], "swalunreg")) {
-		/* Params: swallower's windowid */
-		Client *swer;
-		Window winswer;
-
-		if (numargs == 1) {
-			winswer = strtoul(segments[1], NULL, 0);
-			if ((swer = wintoclient(winswer)))
-				swalunreg(swer);
-		}
-	}
-	else if (!strcmp(segments[0], "swalstop")) {
-		/* Params: swallowee's windowid */
-		Client *swee;
-		Window winswee;
-
-		if (numargs == 1) {
-			winswee = strtoul(segments[1], NULL, 0);
-			if ((swee = wintoclient(winswee)))
-				swalstop(swee, NULL);
-		}
-	}
-	return 1;
-}
-
 void
 focus(Client *c)
 {
@@ -1624,46 +1999,48 @@ getatomprop(Client *c, Atom prop)
 	return atom;
 }
 
-static uint32_t prealpha(uint32_t p) {
-	uint8_t a = p >> 24u;
-	uint32_t rb = (a * (p & 0xFF00FFu)) >> 8u;
-	uint32_t g = (a * (p & 0x00FF00u)) >> 8u;
-	return (rb & 0xFF00FFu) | (g & 0x00FF00u) | (a << 24u);
-}
-
-Picture
-geticonprop(Window win, unsigned int *picw, unsigned int *pich)
+/* Returns a new reference to the icon entry for the best fitting icon in
+ * the window's _NET_WM_ICON, creating the scaled Picture only if no other
+ * window uses the same pixels. */
+Icon *
+geticonprop(Window win)
 {
 	int format;
 	unsigned long n, extra, *p = NULL;
+	uint64_t hash = 14695981039346656037ULL; /* FNV-1a */
 	Atom real;
-
-	if (XGetWindowProperty(dpy, win, netatom[NetWMIcon], 0L, LONG_MAX, False, AnyPropertyType, 
-						   &real, &format, &n, &extra, (unsigned char **)&p) != Success)
-		return None; 
-	if (n == 0 || format != 32) { XFree(p); return None; }
-
-	unsigned long *bstp = NULL;
-	uint32_t w, h, sz;
-	{
-		unsigned long *i; const unsigned long *end = p + n;
-		uint32_t bstd = UINT32_MAX, d, m;
-		for (i = p; i < end - 1; i += sz) {
-			if ((w = *i++) >= 16384 || (h = *i++) >= 16384) { XFree(p); return None; }
-			if ((sz = w * h) > end - i) break;
-			if ((m = w > h ? w : h) >= ICONSIZE && (d = m - ICONSIZE) < bstd) { bstd = d; bstp = i; }
-		}
-		if (!bstp) {
-			for (i = p; i < end - 1; i += sz) {
-				if ((w = *i++) >= 16384 || (h = *i++) >= 16384) { XFree(p); return None; }
-				if ((sz = w * h) > end - i) break;
-				if ((d = ICONSIZE - (w > h ? w : h)) < bstd) { bstd = d; bstp = i; }
-			}
-		}
-		if (!bstp) { XFree(p); return None; }
-	}
-
-	if ((w = *(bstp - 2)) == 0 || (h = *(bstp - 1)) == 0) { XFree(p); return None; }
+	Icon *icon;
+
+	/* Walk the width/height headers only, two longs per request, and fetch
+	 * just the pixels of the chosen image afterwards. Apps shipping large
+	 * icons would otherwise send megabytes over the wire for each map. */
+	long off = 0, len = 2, bsto, bsta = -1, belo = -1;
+	uint32_t w, h, sz, m, aw = 0, ah = 0, lw = 0, lh = 0, da = UINT32_MAX, db = UINT32_MAX;
+	while (off + 2 <= len) {
+		if (XGetWindowProperty(dpy, win, netatom[NetWMIcon], off, 2L, False, AnyPropertyType,
+		                       &real, &format, &n, &extra, (unsigned char **)&p) != Success)
+			return NULL;
+		if (n < 2 || format != 32) { XFree(p); break; }
+		w = p[0]; h = p[1];
+		XFree(p);
+		if (w >= 16384 || h >= 16384) return NULL;
+		if (!off) len = 2 + extra / 4; /* extra is the byte count after this read */
+		if ((sz = w * h) > len - off - 2) break;
+		if (!sz) { off += 2; continue; }
+		m = w > h ? w : h;
+		if (m >= ICONSIZE && m - ICONSIZE < da) { da = m - ICONSIZE; bsta = off; aw = w; ah = h; }
+		if (m < ICONSIZE && ICONSIZE - m < db) { db = ICONSIZE - m; belo = off; lw = w; lh = h; }
+		off += 2 + sz;
+	}
+	/* prefer the smallest icon at least ICONSIZE, else the largest below */
+	if (bsta >= 0) { bsto = bsta; w = aw; h = ah; }
+	else if (belo >= 0) { bsto = belo; w = lw; h = lh; }
+	else return NULL;
+	if (XGetWindowProperty(dpy, win, netatom[NetWMIcon], bsto + 2, (long)w * h, False, AnyPropertyType,
+	                       &real, &format, &n, &extra, (unsigned char **)&p) != Success)
+		return NULL;
+	if (n != w * h || format != 32) { XFree(p); return NULL; }
+	unsigned long *bstp = p;
 
 	uint32_t icw, ich;
 	if (w <= h) {
@@ -1674,15 +2051,57 @@ geticonprop(Window win, unsigned int *picw, unsigned int *pich)
 		icw = ICONSIZE; ich = h * ICONSIZE / w;
 		if (ich == 0) ich = 1;
 	}
-	*picw = icw; *pich = ich;
 
-	uint32_t i, *bstp32 = (uint32_t *)bstp;
-	for (sz = w * h, i = 0; i < sz; ++i) bstp32[i] = prealpha(bstp[i]);
+	uint32_t i, key[3] = { w, h, ICONSIZE };
+	for (i = 0; i < LENGTH(key); ++i) hash = (hash ^ key[i]) * 1099511628211ULL;
+	for (sz = w * h, i = 0; i < sz; ++i) hash = (hash ^ (uint32_t)bstp[i]) * 1099511628211ULL;
+	for (icon = icons; icon; icon = icon->next) {
+		if (icon->hash != hash || icon->srcw != w || icon->srch != h
+		|| icon->w != icw || icon->h != ich)
+			continue;
+		for (i = 0; i < sz && icon->src[i] == (uint32_t)bstp[i]; ++i);
+		if (i == sz) {
+			icon->refs++;
+			XFree(p);
+			return icon;
+		}
+	}
 
-	Picture ret = drw_picture_create_resized(drw, (char *)bstp, w, h, icw, ich);
+	if (maxicons && nicons >= maxicons)
+		evicticon();
+	icon = ecalloc(1, sizeof(Icon));
+	nicons++;
+	icon->hash = hash;
+	icon->src = ecalloc(sz, sizeof(uint32_t));
+	for (i = 0; i < sz; ++i) icon->src[i] = bstp[i];
+	icon->srcw = w;
+	icon->srch = h;
+	icon->w = icw;
+	icon->h = ich;
+	icon->refs = 1;
+	icon->next = icons;
+	icons = icon;
+
+	/* scaling is left to the worker, the bar keeps the icon's space
+	 * blank until iconjobdone() */
+	IconJob *j = ecalloc(1, sizeof(IconJob));
+	j->job.run = iconjobrun;
+	j->job.done = iconjobdone;
+	j->icon = icon;
+	j->px = ecalloc(sz, sizeof(uint32_t));
+	memcpy(j->px, icon->src, sz * sizeof(uint32_t));
+	j->w = w;
+	j->h = h;
+	j->dstw = icw;
+	j->dsth = ich;
 	XFree(p);
+	icon->pending = 1;
+	if (!worker_submit(&j->job)) {
+		iconjobrun(&j->job);
+		iconjobdone(&j->job);
+	}
 
-	return ret;
+	return icon;
 }
 
 int
@@ -1695,6 +2114,44 @@ getrootptr(int *x, int *y)
 	return XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
 }
 
+/* Returns the parent of process p, 0 if unknown. Entries read from /proc
+ * are kept for 30s, the same ancestors are looked up for every window a
+ * terminal starts. With 'check' set /proc is read in any case, and 0 is
+ * returned if the cached entry was of an earlier process with pid p. */
+pid_t
+getparentprocess(pid_t p, int check)
+{
+	PidCache *e = &pidcache[(unsigned int)p % LENGTH(pidcache)];
+	struct timespec now;
+	char buf[512], path[32], *s;
+	unsigned long long start;
+	ssize_t n;
+	int fd, ppid, reused;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!check && e->pid == p && now.tv_sec - e->at < 30)
+		return e->ppid;
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)p);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+		return 0;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	buf[n] = '\0';
+	/* the command name may contain spaces and parentheses itself, the
+	 * start time is the 22nd field */
+	if (!(s = strrchr(buf, ')')) || sscanf(s + 1, " %*c %d %*d %*d %*d %*d %*u"
+		" %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &ppid, &start) != 2)
+		return 0;
+	reused = e->pid == p && e->start != start;
+	e->pid = p;
+	e->ppid = ppid;
+	e->start = start;
+	e->at = now.tv_sec;
+	return check && reused ? 0 : ppid;
+}
+
 long
 getstate(Window w)
 {
@@ -1716,11 +2173,8 @@ getstate(Window w)
 unsigned int
 getsystraywidth()
 {
-	unsigned int w = 0;
-	Client *i;
-	if (showsystray)
-		for (i = systray->icons; i; w += i->w + systrayspacing, i = i->next);
-	return w ? w + systrayspacing : 0;
+	/* kept up to date by updatesystray() */
+	return showsystray ? systrayw : 0;
 }
 
 int
@@ -1748,6 +2202,24 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
 	return 1;
 }
 
+pid_t
+getwinpid(Window w)
+{
+	int di;
+	unsigned long n, dl;
+	unsigned char *p = NULL;
+	Atom da;
+	pid_t pid = 0;
+
+	if (XGetWindowProperty(dpy, w, netatom[NetWMPid], 0L, 1L, False, XA_CARDINAL,
+		&da, &di, &n, &dl, &p) == Success && p) {
+		if (n == 1)
+			pid = *(long *)p;
+		XFree(p);
+	}
+	return pid;
+}
+
 void
 grabbuttons(Client *c, int focused)
 {
@@ -1816,64 +2288,430 @@ isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
 #endif /* XINERAMA */
 
 void
-keypress(XEvent *e)
+ipcaccept(int fd, short revents)
 {
-	unsigned int i;
-	KeySym keysym;
-	XKeyEvent *ev;
+	IPCClient *c;
+	int cfd;
 
-	ev = &e->xkey;
-	keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
-	for (i = 0; i < LENGTH(keys); i++)
-		if (keysym == keys[i].keysym
-		&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
-		&& keys[i].func)
-			keys[i].func(&(keys[i].arg));
+	if ((cfd = accept(fd, NULL, NULL)) == -1)
+		return;
+	if (nwatches == LENGTH(watches)) { /* refuse rather than die in addwatch() */
+		close(cfd);
+		return;
+	}
+	fcntl(cfd, F_SETFD, FD_CLOEXEC);
+	fcntl(cfd, F_SETFL, O_NONBLOCK);
+	c = ecalloc(1, sizeof(IPCClient));
+	c->fd = cfd;
+	c->next = ipcclients;
+	ipcclients = c;
+	addwatch(cfd, ipcread);
 }
 
-int
-fake_signal(void)
-{
-	char fsignal[256];
-	char indicator[9] = "fsignal:";
-	char str_signum[16];
-	int i, v, signum;
-	size_t len_fsignal, len_indicator = strlen(indicator);
-
-	// Get root name property
-	if (gettextprop(root, XA_WM_NAME, fsignal, sizeof(fsignal))) {
-		len_fsignal = strlen(fsignal);
-
-		// Check if this is indeed a fake signal
-		if (len_indicator > len_fsignal ? 0 : strncmp(indicator, fsignal, len_indicator) == 0) {
-			memcpy(str_signum, &fsignal[len_indicator], len_fsignal - len_indicator);
-			str_signum[len_fsignal - len_indicator] = '\0';
-
-			// Convert string value into managable integer
-			for (i = signum = 0; i < strlen(str_signum); i++) {
-				v = str_signum[i] - '0';
-				if (v >= 0 && v <= 9) {
-					signum = signum * 10 + v;
-				}
-			}
-
-			// Check if a signal was found, and if so handle it
-			if (signum)
-				for (i = 0; i < LENGTH(signals); i++)
-					if (signum == signals[i].signum && signals[i].func)
-						signals[i].func(&(signals[i].arg));
+/* block name [text]: sets a named status block, or removes it without
+ * text. Blocks are shown after the root window name in the order they were
+ * first set. */
+const char *
+ipcblock(char **argv, size_t argc)
+{
+	if (argc < 2 || argc > 3)
+		return "usage: block name [text]";
+	if (!*argv[1] || strlen(argv[1]) >= sizeof(blocks[0].name))
+		return "invalid block name";
+	return setstatusblock(argv[1], argv[2]);
+}
 
-			// A fake signal was sent
-			return 1;
-		}
-	}
+void
+ipcclose(IPCClient *c)
+{
+	IPCClient **pc;
 
-	// No fake signal was sent, so proceed with update
-	return 0;
+	for (pc = &ipcclients; *pc && *pc != c; pc = &(*pc)->next);
+	*pc = c->next;
+	delwatch(c->fd);
+	close(c->fd);
+	free(c);
 }
 
 void
-killclient(const Arg *arg)
+ipccommand(IPCClient *c, char *line)
+{
+	char *argv[8] = {0}, *end, result[IPCMAXLINE] = "";
+	const char *err = NULL;
+	const IPCCommand *cmd = NULL;
+	size_t argc, i;
+	int subscribe = 0;
+	Arg arg;
+
+	argc = split(line, IPCSEP, argv, LENGTH(argv));
+	if (!argc || !*argv[0])
+		return;
+	if (!strncmp(argv[0], "swal", 4)) {
+		err = ipcswallow(argv, argc);
+	} else if (!strcmp(argv[0], "block")) {
+		err = ipcblock(argv, argc);
+	} else if (!strcmp(argv[0], "stats")) {
+		err = ipcstats(argv, argc, result, sizeof(result));
+	} else if (!strcmp(argv[0], "subscribe")) {
+		err = ipcsubscribe(c, argv, argc);
+		subscribe = !err;
+	} else {
+		for (i = 0; i < LENGTH(ipccommands) && !cmd; i++)
+			if (!strcmp(argv[0], ipccommands[i].name))
+				cmd = &ipccommands[i];
+		if (!cmd)
+			err = "unknown command";
+		else if (argc > 2 || (argc == 2 && cmd->argtype == IPCNone))
+			err = "too many arguments";
+	}
+	if (cmd && !err) {
+		arg = cmd->arg;
+		errno = 0;
+		if (argc == 2) {
+			switch (cmd->argtype) {
+			case IPCInt: arg.i = strtol(argv[1], &end, 0); break;
+			case IPCUint: arg.ui = strtoul(argv[1], &end, 0); break;
+			case IPCFloat: arg.f = strtof(argv[1], &end); break;
+			}
+			if (errno || end == argv[1] || *end)
+				err = "invalid argument";
+		}
+		if (!err)
+			cmd->func(&arg);
+	}
+	if (err) {
+		ipcwrite(c, "error" IPCSEP, 6);
+		ipcwrite(c, err, strlen(err));
+		ipcwrite(c, "\n", 1);
+	} else if (*result) {
+		ipcwrite(c, "ok" IPCSEP, 3);
+		ipcwrite(c, result, strlen(result));
+		ipcwrite(c, "\n", 1);
+	} else {
+		ipcwrite(c, "ok\n", 3);
+	}
+	if (subscribe)
+		ipcnotify(c); /* the current state, changes follow */
+}
+
+/* Queues a line for the subscribers of event, or for to alone. */
+void
+ipcemit(IPCClient *to, int event, const char *fmt, ...)
+{
+	char line[IPCMAXLINE];
+	IPCClient *c;
+	va_list ap;
+	int n;
+
+	for (c = to ? to : ipcclients; c && !(c->events & event); c = to ? NULL : c->next);
+	if (!c)
+		return;
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	n = MIN(n, (int)sizeof(line) - 2);
+	line[n++] = '\n';
+	for (; c; c = to ? NULL : c->next)
+		if (c->events & event)
+			ipcwrite(c, line, n);
+}
+
+/* Sends as much of the ring as the socket takes without blocking, the rest
+ * goes out once poll() reports the socket writable again. */
+void
+ipcflush(IPCClient *c)
+{
+	ssize_t n;
+
+	while (c->outlen) {
+		n = send(c->fd, c->out + c->outpos, MIN(c->outlen, sizeof(c->out) - c->outpos),
+			MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				/* ipcread() closes the client on the hangup */
+				c->outlen = 0;
+				c->events = 0;
+			}
+			break;
+		}
+		c->outpos = (c->outpos + n) % sizeof(c->out);
+		c->outlen -= n;
+	}
+	if (!c->outlen)
+		c->outpos = 0;
+	setwatch(c->fd, c->outlen ? POLLIN | POLLOUT : POLLIN);
+}
+
+/* Tells the subscribers what changed since the last call, or the new
+ * subscriber to everything. run() calls it after each batch of events, so a
+ * burst of X events collapses into at most one line per kind and monitor.
+ * The state kept is not updated while no one subscribes, the first
+ * subscriber after such a pause makes what it was told the new one. */
+void
+ipcnotify(IPCClient *to)
+{
+	IPCClient *ic;
+	IPCState *s, now;
+	Client *c;
+	Monitor *m;
+	int update;
+
+	for (ic = to ? to : ipcclients; ic && !ic->events; ic = ic->next);
+	if (!ic)
+		return;
+	for (ic = ipcclients; ic && (ic == to || !ic->events); ic = ic->next);
+	update = !to || !ic;
+	for (m = mons; m; m = m->next) {
+		s = &m->ipcstate;
+		now.sel = m->sel ? m->sel->win : None;
+		now.view = m->tagset[m->seltags];
+		now.occ = now.urg = 0;
+		for (c = m->clients; c; c = c->next) {
+			now.occ |= c->tags;
+			if (c->isurgent)
+				now.urg |= c->tags;
+		}
+		if (to || now.sel != s->sel)
+			ipcemit(to, IPCEvFocus, "focus" IPCSEP "%d" IPCSEP "0x%lx", m->num, now.sel);
+		if (to || now.view != s->view || now.occ != s->occ || now.urg != s->urg)
+			ipcemit(to, IPCEvTags, "tags" IPCSEP "%d" IPCSEP "%u" IPCSEP "%u" IPCSEP "%u",
+				m->num, now.view, now.occ, now.urg);
+		if (to || strcmp(m->ltsymbol, s->ltsymbol) || m->mfact != s->mfact || m->nmaster != s->nmaster)
+			ipcemit(to, IPCEvLayout, "layout" IPCSEP "%d" IPCSEP "%s" IPCSEP "%.2f" IPCSEP "%d",
+				m->num, m->ltsymbol, m->mfact, m->nmaster);
+		if (!update)
+			continue;
+		s->sel = now.sel;
+		s->view = now.view;
+		s->occ = now.occ;
+		s->urg = now.urg;
+		strcpy(s->ltsymbol, m->ltsymbol);
+		s->mfact = m->mfact;
+		s->nmaster = m->nmaster;
+	}
+	if (to || selmon->num != ipcselmon)
+		ipcemit(to, IPCEvMonitor, "monitor" IPCSEP "%d", selmon->num);
+	if (update)
+		ipcselmon = selmon->num;
+}
+
+void
+ipcqueue(IPCClient *c, const char *s, size_t n)
+{
+	size_t i = (c->outpos + c->outlen) % sizeof(c->out);
+	size_t k = MIN(n, sizeof(c->out) - i);
+
+	memcpy(c->out + i, s, k);
+	memcpy(c->out, s + k, n - k);
+	c->outlen += n;
+}
+
+void
+ipcread(int fd, short revents)
+{
+	IPCClient *c;
+	char *nl;
+	ssize_t n;
+
+	for (c = ipcclients; c && c->fd != fd; c = c->next);
+	if (!c)
+		return;
+	if (revents & POLLOUT)
+		ipcflush(c);
+	if (!(revents & (POLLIN | POLLHUP | POLLERR)))
+		return;
+	if ((n = read(fd, c->buf + c->len, sizeof(c->buf) - c->len)) <= 0) {
+		if (n == 0 || (errno != EAGAIN && errno != EINTR))
+			ipcclose(c);
+		return;
+	}
+	c->len += n;
+	while ((nl = memchr(c->buf, '\n', c->len))) {
+		*nl = '\0';
+		ipccommand(c, c->buf);
+		c->len -= nl + 1 - c->buf;
+		memmove(c->buf, nl + 1, c->len);
+	}
+	if (c->len == sizeof(c->buf)) /* a line longer than the buffer */
+		ipcclose(c);
+}
+
+void
+ipcsetup(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const char *dir = getenv("XDG_RUNTIME_DIR"), *display = getenv("DISPLAY");
+	mode_t mask;
+	int r;
+
+	/* a shared directory like /tmp would let anyone race for the path */
+	if (!dir || !*dir) {
+		fprintf(stderr, "dwm: XDG_RUNTIME_DIR not set, no IPC\n");
+		return;
+	}
+	if (snprintf(ipcpath, sizeof(ipcpath), IPCSOCKET, dir,
+	    display ? display : "") >= sizeof(ipcpath)) {
+		fprintf(stderr, "dwm: socket path too long, no IPC\n");
+		return;
+	}
+	strcpy(addr.sun_path, ipcpath);
+	if ((ipcfd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		perror("dwm: socket");
+		return;
+	}
+	fcntl(ipcfd, F_SETFD, FD_CLOEXEC);
+	fcntl(ipcfd, F_SETFL, O_NONBLOCK);
+	unlink(ipcpath); /* left over by a crash or restart */
+	/* the socket is created 0600, only our user may drive dwm */
+	mask = umask(077);
+	r = bind(ipcfd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (r == -1 || listen(ipcfd, 8) == -1) {
+		perror("dwm: bind");
+		close(ipcfd);
+		ipcfd = -1;
+		return;
+	}
+	addwatch(ipcfd, ipcaccept);
+}
+
+/* Swallow operations, formerly passed through the root window name. */
+const char *
+ipcswallow(char **argv, size_t argc)
+{
+	Client *swer, *swee;
+	int typeswer, typeswee;
+
+	if (!strcmp(argv[0], "swalreg")) {
+		/* swalreg window [class [instance [title]]] */
+		if (argc < 2 || argc > 5)
+			return "usage: swalreg window [class [instance [title]]]";
+		switch (wintoclient2(strtoul(argv[1], NULL, 0), &swer, NULL)) {
+		case ClientRegular: /* fallthrough */
+		case ClientSwallowee:
+			swalreg(swer, argv[2], argv[3], argv[4]);
+			return NULL;
+		}
+		return "no such window";
+	} else if (!strcmp(argv[0], "swal")) {
+		/* swal swallower swallowee */
+		if (argc != 3)
+			return "usage: swal swallower swallowee";
+		typeswer = wintoclient2(strtoul(argv[1], NULL, 0), &swer, NULL);
+		typeswee = wintoclient2(strtoul(argv[2], NULL, 0), &swee, NULL);
+		if ((typeswer != ClientRegular && typeswer != ClientSwallowee)
+		|| (typeswee != ClientRegular && typeswee != ClientSwallowee))
+			return "no such window";
+		swal(swer, swee, 0);
+		return NULL;
+	} else if (!strcmp(argv[0], "swalunreg")) {
+		/* swalunreg swallower */
+		if (argc != 2)
+			return "usage: swalunreg window";
+		if (!(swer = wintoclient(strtoul(argv[1], NULL, 0))))
+			return "no such window";
+		swalunreg(swer);
+		return NULL;
+	} else if (!strcmp(argv[0], "swalstop")) {
+		/* swalstop swallowee */
+		if (argc != 2)
+			return "usage: swalstop window";
+		if (!(swee = wintoclient(strtoul(argv[1], NULL, 0))))
+			return "no such window";
+		swalstop(swee, NULL);
+		return NULL;
+	}
+	return "unknown command";
+}
+
+/* stats: answers with the number of programs spawned and the time spent
+ * starting them, in microseconds. */
+const char *
+ipcstats(char **argv, size_t argc, char *out, size_t size)
+{
+	if (argc != 1)
+		return "too many arguments";
+	snprintf(out, size, "spawns" IPCSEP "%lu" IPCSEP "last" IPCSEP "%ld" IPCSEP
+		"mean" IPCSEP "%lld" IPCSEP "max" IPCSEP "%ld",
+		spawnstats.count, spawnstats.last,
+		spawnstats.count ? spawnstats.total / (long long)spawnstats.count : 0,
+		spawnstats.max);
+	return NULL;
+}
+
+/* subscribe [event]...: turns the connection into an event stream, of all
+ * events if none are named. */
+const char *
+ipcsubscribe(IPCClient *c, char **argv, size_t argc)
+{
+	size_t i, j;
+	int events = 0;
+
+	for (i = 1; i < argc; i++) {
+		for (j = 0; j < LENGTH(ipcevents) && strcmp(argv[i], ipcevents[j]); j++);
+		if (j == LENGTH(ipcevents))
+			return "unknown event";
+		events |= 1 << j;
+	}
+	c->events = events ? events : ~0;
+	return NULL;
+}
+
+void
+ipctitle(Client *c)
+{
+	char name[sizeof(c->name)], *p;
+
+	if (!ipcclients)
+		return;
+	strcpy(name, c->name);
+	for (p = name; (p = strpbrk(p, IPCSEP "\n")); p++)
+		*p = ' ';
+	ipcemit(NULL, IPCEvTitle, "title" IPCSEP "0x%lx" IPCSEP "%s", c->win, name);
+}
+
+/* Queues a line and sends what it can right away. A subscriber which does not
+ * keep up loses whole lines and is told how many before the next one. */
+void
+ipcwrite(IPCClient *c, const char *s, size_t n)
+{
+	char lost[32];
+	size_t m = 0;
+
+	if (c->lost)
+		m = snprintf(lost, sizeof(lost), "lost" IPCSEP "%lu\n", c->lost);
+	if (m + n > sizeof(c->out) - c->outlen) {
+		c->lost++;
+		return;
+	}
+	c->lost = 0;
+	ipcqueue(c, lost, m);
+	ipcqueue(c, s, n);
+	ipcflush(c);
+}
+
+void
+keypress(XEvent *e)
+{
+	unsigned int i;
+	KeySym keysym;
+	XKeyEvent *ev;
+
+	ev = &e->xkey;
+	keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
+	for (i = 0; i < LENGTH(keys); i++)
+		if (keysym == keys[i].keysym
+		&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
+		&& keys[i].func)
+			keys[i].func(&(keys[i].arg));
+}
+
+void
+killclient(const Arg *arg)
 {
 	if (!selmon->sel)
 		return;
@@ -1888,24 +2726,84 @@ killclient(const Arg *arg)
 	}
 }
 
-void
-layoutmenu(const Arg *arg) {
-	FILE *p;
-	char c[5] = {};
-	int i;
+/* Starts argv in its own session with the environment envp and, unless it
+ * is -1, out as standard output. Returns the pid, -1 on failure.
+ * posix_spawn() spares copying dwm's page tables, which fork() has to do for
+ * all of the font caches. */
+pid_t
+launch(const char *const argv[], char *const envp[], int out)
+{
+	struct timespec t0;
+	pid_t pid = -1;
+	long us;
+	int err;
+#ifdef POSIX_SPAWN_SETSID
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t attr;
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+#ifdef POSIX_SPAWN_SETSID
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+	posix_spawn_file_actions_init(&fa);
+	if (out != -1)
+		posix_spawn_file_actions_adddup2(&fa, out, STDOUT_FILENO);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+	/* also whatever dwm inherited itself */
+	posix_spawn_file_actions_addclosefrom_np(&fa, STDERR_FILENO + 1);
+#else
+	if (out != -1)
+		posix_spawn_file_actions_addclose(&fa, out);
+	if (dpy)
+		posix_spawn_file_actions_addclose(&fa, ConnectionNumber(dpy));
+#endif
+	err = posix_spawnp(&pid, argv[0], &fa, &attr, (char *const *)argv, envp);
+	posix_spawn_file_actions_destroy(&fa);
+	posix_spawnattr_destroy(&attr);
+#else
+	if ((pid = fork()) == 0) {
+		if (dpy)
+			close(ConnectionNumber(dpy));
+		if (out != -1) {
+			dup2(out, STDOUT_FILENO);
+			close(out);
+		}
+		setsid();
+		environ = (char **)envp;
+		execvp(argv[0], (char *const *)argv);
+		fprintf(stderr, "dwm: execvp %s", argv[0]);
+		perror(" failed");
+		_exit(EXIT_FAILURE);
+	}
+	err = pid == -1 ? errno : 0;
+#endif
+	if (err) {
+		fprintf(stderr, "dwm: spawn %s failed: %s\n", argv[0], strerror(err));
+		return -1;
+	}
+	us = usince(&t0);
+	spawnstats.count++;
+	spawnstats.total += us;
+	spawnstats.last = us;
+	spawnstats.max = MAX(spawnstats.max, us);
+	return pid;
+}
 
-	if (!(p = popen(layoutmenu_cmd, "r")))
-		 return;
-  if (!feof(p))
-    fscanf(p, "%s", c);
-	pclose(p);
+void
+layoutchosen(const char *choice)
+{
+	char *end;
+	long i = strtol(choice, &end, 10);
 
-	if (!c || *c == '\0') {
-    return;
-  }
+	/* the last layout is the { NULL, NULL } terminator */
+	if (end != choice && i >= 0 && i < LENGTH(layouts) - 1)
+		setlayout(&((Arg) { .v = &layouts[i] }));
+}
 
-	i = atoi(c);
-	setlayout(&((Arg) { .v = &layouts[i] }));
+void
+layoutmenu(const Arg *arg) {
+	runmenu(layoutmenu_cmd, layoutchosen);
 }
 
 void
@@ -1917,6 +2815,7 @@ manage(Window w, XWindowAttributes *wa)
 
 	c = ecalloc(1, sizeof(Client));
 	c->win = w;
+	c->netdesk = -2;
 	/* geometry */
 	c->x = c->oldx = wa->x;
 	c->y = c->oldy = wa->y;
@@ -1925,7 +2824,7 @@ manage(Window w, XWindowAttributes *wa)
 	c->oldbw = wa->border_width;
 	c->cfact = 1.0;
 
-	updateicon(c);
+	c->iconstale = 1; /* loaded by drawbar() once it is shown */
 	updatetitle(c);
 	if (XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans))) {
 		c->mon = t->mon;
@@ -1934,6 +2833,8 @@ manage(Window w, XWindowAttributes *wa)
 		c->mon = selmon;
 		applyrules(c);
 	}
+	if (c->isterminal)
+		c->pid = getwinpid(w);
 
 	if (c->x + WIDTH(c) > c->mon->mx + c->mon->mw)
 		c->x = c->mon->mx + c->mon->mw - WIDTH(c);
@@ -1965,36 +2866,23 @@ manage(Window w, XWindowAttributes *wa)
 		c->isfloating = c->oldstate = trans != None || c->isfixed;
 	if (c->isfloating)
 		XRaiseWindow(dpy, c->win);
-	switch(attachdirection){
-		case 1:
-			attachabove(c);
-			break;
-		case 2:
-			attachaside(c);
-			break;
-		case 3:
-			attachbelow(c);
-			break;
-		case 4:
-			attachbottom(c);
-			break;
-		case 5:
-			attachtop(c);
-			break;
-		default:
-			attach(c);
-	}
+	attachdirected(c);
 	attachstack(c);
-	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-		(unsigned char *) &(c->win), 1);
+	/* pooled windows are announced once poolclaim() shows them */
+	if (!c->pool)
+		clientlistadd(c->win);
 	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
 	setclientstate(c, NormalState);
-	if (c->mon == selmon)
-		unfocus(selmon->sel, 0);
-	c->mon->sel = c;
+	if (!c->pool) {
+		if (c->mon == selmon)
+			unfocus(selmon->sel, 0);
+		c->mon->sel = c;
+	}
 	arrange(c->mon);
 	XMapWindow(dpy, c->win);
 	focus(NULL);
+	if (!c->pool)
+		ipcemit(NULL, IPCEvClient, "map" IPCSEP "0x%lx" IPCSEP "%d", c->win, c->mon->num);
 }
 
 void
@@ -2010,9 +2898,10 @@ mappingnotify(XEvent *e)
 void
 maprequest(XEvent *e)
 {
-	Client *c, *swee, *root;
+	Client *c, *swee, *swer, *root;
 	static XWindowAttributes wa;
 	XMapRequestEvent *ev = &e->xmaprequest;
+	XClassHint ch = { NULL, NULL };
 	Swallow *s;
 
 	Client *i;
@@ -2040,17 +2929,25 @@ maprequest(XEvent *e)
 		swalstop(swee, root);
 		break;
 	default:
-		/* No client is managing the window. See if any swallows match. */
-		if ((s = swalmatch(ev->window)))
-			swalmanage(s, ev->window, &wa);
+		/* No client is managing the window. See if any swallows match,
+		 * or if it was started from a terminal. */
+		if ((s = swalmatch(ev->window, &ch))) {
+			swer = s->client;
+			swalrm(s);
+			swalmanage(swer, ev->window, &wa);
+		} else if (swalauto && (swer = swalterminal(ev->window, &ch)))
+			swalmanage(swer, ev->window, &wa);
 		else
 			manage(ev->window, &wa);
+		if (ch.res_class)
+			XFree(ch.res_class);
+		if (ch.res_name)
+			XFree(ch.res_name);
 		break;
 	}
 
-	/* Reduce decay counter of all swallow instances. */
 	if (swaldecay)
-		swaldecayby(1);
+		swalexpire();
 }
 
 /*
@@ -2119,6 +3016,64 @@ monocle(Monitor *m)
 
 }
 
+/* Measures a status block and records where its control byte delimited
+ * segments end, so that buttonpress() can resolve statuscmdn without
+ * measuring any text. */
+void
+measureblock(StatusBlock *b)
+{
+	char *text, *s, ch;
+	int id = 0;
+
+	b->w = b->nsegs = 0;
+	for (text = s = b->text; ; s++) {
+		if (*s && (unsigned char)(*s) >= ' ')
+			continue;
+		ch = *s;
+		*s = '\0';
+		b->w += textw2d(text);
+		*s = ch;
+		if (b->nsegs == LENGTH(b->segs))
+			b->nsegs--; /* fold the excess into the last segment */
+		b->segs[b->nsegs].x = b->w;
+		b->segs[b->nsegs++].id = id;
+		if (!ch)
+			break;
+		id = ch;
+		text = s + 1;
+	}
+}
+
+void
+menuread(int fd, short revents)
+{
+	Menu *m, **pm;
+	ssize_t n;
+
+	for (pm = &menus; *pm && (*pm)->fd != fd; pm = &(*pm)->next);
+	if (!(m = *pm))
+		return;
+	n = read(fd, m->out + m->len, sizeof(m->out) - 1 - m->len);
+	if (n == -1 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n > 0 && (m->len += n) < sizeof(m->out) - 1)
+		return; /* wait for the menu to exit */
+	*pm = m->next;
+	delwatch(fd);
+	close(fd);
+	m->out[m->len] = '\0';
+	m->out[strcspn(m->out, "\n")] = '\0';
+	if (*m->out)
+		m->done(m->out);
+	free(m);
+}
+
+long
+msince(const struct timespec *t)
+{
+	return usince(t) / 1000;
+}
+
 void
 motionnotify(XEvent *e)
 {
@@ -2247,12 +3202,129 @@ prevtiled(Client *c) {
 	return r;
 }
 
+/* Shows a window waiting in the pool of arg->v as if it had just been
+ * mapped, or starts arg->v if there is none. */
+void
+poolclaim(const Arg *arg)
+{
+	poolshow(arg, 0);
+}
+
+/* Starts windows for the pools short of their size, e.g. after one was
+ * shown or died while waiting. A pool is refilled at most once a second, a
+ * command whose windows die right away is not restarted in a loop. Windows
+ * which did not show up within 10s are no longer waited for. Returns the
+ * milliseconds until it is due again, or -1 if it is not. */
+int
+poolfill(void)
+{
+	Client *c;
+	Monitor *m;
+	PoolState *ps;
+	unsigned int i, k, n;
+	long ms, due, timeout = -1;
+
+	for (i = 0; i < LENGTH(pools) && pools[i].instance; i++) {
+		ps = &poolstate[i];
+		ms = msince(&ps->since);
+		if (ps->pending && ms > 10000)
+			ps->pending = ps->claimed = ps->scratch = 0;
+		n = ps->pending - ps->claimed;
+		for (m = mons; m; m = m->next)
+			for (c = m->clients; c; c = c->next)
+				n += c->pool == i + 1;
+		if (n < pools[i].size && ms >= 1000) {
+			clock_gettime(CLOCK_MONOTONIC, &ps->since);
+			ms = 0;
+			for (k = n; k < pools[i].size; k++)
+				if (launch(pools[i].cmd, environ, -1) > 0) {
+					ps->pending++;
+					n++;
+				}
+		}
+		due = n < pools[i].size ? 1000 - ms : ps->pending ? 10001 - ms : -1;
+		if (due != -1 && (timeout == -1 || due < timeout))
+			timeout = due;
+	}
+	return timeout;
+}
+
+/* Closes the windows waiting in pools, a new dwm starts its own. */
+void
+poolkill(void)
+{
+	Client *c;
+	Monitor *m;
+
+	XSetErrorHandler(xerrordummy);
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			if (c->pool)
+				XKillClient(dpy, c->win);
+	XSync(dpy, False);
+	XSetErrorHandler(xerror);
+}
+
+/* Like poolclaim(), but the window floats as the scratchpad shown last, so
+ * that scratchpad_hide() and scratchpad_show() take it from there. */
+void
+poolscratchpad(const Arg *arg)
+{
+	poolshow(arg, 1);
+}
+
+void
+poolshow(const Arg *arg, int scratchpad)
+{
+	Client *c = NULL;
+	Monitor *m;
+	unsigned int i;
+
+	for (i = 0; i < LENGTH(pools) && pools[i].instance && pools[i].cmd != arg->v; i++);
+	for (m = mons; m && !c && i < LENGTH(pools) && pools[i].instance; m = m->next)
+		for (c = m->clients; c && c->pool != i + 1; c = c->next);
+	if (!c) {
+		if (i == LENGTH(pools) || !pools[i].instance) {
+			spawn(arg);
+			return;
+		}
+		/* its window has the instance of the pool, keep it from being hidden */
+		if (launch(pools[i].cmd, environ, -1) > 0) {
+			poolstate[i].pending++;
+			poolstate[i].claimed++;
+			poolstate[i].scratch += scratchpad;
+			clock_gettime(CLOCK_MONOTONIC, &poolstate[i].since);
+		}
+		poolfill();
+		return;
+	}
+	c->pool = 0;
+	detach(c);
+	detachstack(c);
+	c->mon = selmon;
+	c->tags = selmon->tagset[selmon->seltags];
+	if (scratchpad) {
+		c->isfloating = 1;
+		scratchpad_last_showed = c;
+	}
+	attachdirected(c);
+	attachstack(c);
+	clientlistadd(c->win);
+	if (c->isfloating)
+		XRaiseWindow(dpy, c->win);
+	focus(c);
+	arrange(selmon);
+	ipcemit(NULL, IPCEvClient, "map" IPCSEP "0x%lx" IPCSEP "%d", c->win, c->mon->num);
+	poolfill();
+}
+
 void
 propertynotify(XEvent *e)
 {
 	Client *c;
 	Window trans;
 	Swallow *s;
+	XClassHint ch = { NULL, NULL };
 	XPropertyEvent *ev = &e->xproperty;
 
 	if (showsystray && (c = wintosystrayicon(ev->window))) {
@@ -2266,8 +3338,7 @@ propertynotify(XEvent *e)
 	}
 
 	if ((ev->window == root) && (ev->atom == XA_WM_NAME)) {
-		if (!fake_signal() && !fakesignal())
-			updatestatus();
+		updatestatus();
   } else if (ev->state == PropertyDelete)
 		return; /* ignore */
 	else if ((c = wintoclient(ev->window))) {
@@ -2288,16 +3359,20 @@ propertynotify(XEvent *e)
 		}
 		if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
 			updatetitle(c);
+			ipctitle(c);
 			if (c == c->mon->sel)
 				drawbar(c->mon);
 		}
 		else if (ev->atom == netatom[NetWMIcon]) {
-			updateicon(c);
+			c->iconstale = 1;
 			if (c == c->mon->sel)
 				drawbar(c->mon);
-			if (swalretroactive && (s = swalmatch(c->win))) {
+			if (swalretroactive && (s = swalmatch(c->win, &ch)))
 				swal(s->client, c, 0);
-			}
+			if (ch.res_class)
+				XFree(ch.res_class);
+			if (ch.res_name)
+				XFree(ch.res_name);
 		}
 		if (ev->atom == netatom[NetWMWindowType])
 			updatewindowtype(c);
@@ -2396,6 +3471,63 @@ pushup(const Arg *arg) {
 	arrange(selmon);
 }
 
+/* Rewrites the shared state if anything in it changed. Readers detect a
+ * write in progress by the odd sequence number and retry, see dwmstate.h. */
+void
+publishstate(void)
+{
+	const size_t off = offsetof(DwmState, version);
+	DwmState *s = &statenext;
+	DwmStateMonitor *sm;
+	DwmStateClient *sc;
+	Monitor *m;
+	Client *c;
+	uint32_t seq;
+
+	if (!statemap)
+		return;
+	memset(s, 0, sizeof(*s)); /* padding and unused entries compare equal */
+	s->version = DWMSTATE_VERSION;
+	s->pid = getpid();
+	s->selmon = selmon->num;
+	for (m = mons; m && s->nmons < DWMSTATE_MONITORS; m = m->next) {
+		sm = &s->mons[s->nmons++];
+		sm->num = m->num;
+		sm->x = m->mx;
+		sm->y = m->my;
+		sm->w = m->mw;
+		sm->h = m->mh;
+		sm->tagset = m->tagset[m->seltags];
+		strcpy(sm->ltsymbol, m->ltsymbol);
+		sm->mfact = m->mfact;
+		sm->nmaster = m->nmaster;
+		sm->sel = m->sel ? m->sel->win : 0;
+		for (c = m->clients; c && s->nclients < DWMSTATE_CLIENTS; c = c->next) {
+			if (c->pool)
+				continue;
+			sc = &s->clients[s->nclients++];
+			sc->win = c->win;
+			sc->mon = m->num;
+			sc->tags = c->tags;
+			sc->x = c->x;
+			sc->y = c->y;
+			sc->w = c->w;
+			sc->h = c->h;
+			sc->flags = (c->isfloating ? DwmStateFloating : 0)
+				| (c->isfullscreen ? DwmStateFullscreen : 0)
+				| (c->isurgent ? DwmStateUrgent : 0);
+			strcpy(sc->name, c->name);
+		}
+	}
+	if (!memcmp((char *)s + off, (char *)statemap + off, sizeof(*s) - off))
+		return;
+	seq = statemap->seq;
+	__atomic_store_n(&statemap->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy((char *)statemap + off, (char *)s + off, sizeof(*s) - off);
+	__atomic_store_n(&statemap->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
 void
 quit(const Arg *arg)
 {
@@ -2406,6 +3538,23 @@ quit(const Arg *arg)
 		saveSession();
 }
 
+void
+reapchildren(int fd, short revents)
+{
+	char buf[64];
+	pid_t pid;
+	size_t i;
+	int status;
+
+	while (read(fd, buf, sizeof(buf)) > 0);
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		for (i = 0; i < nautostartjobs; i++)
+			if (autostartjobs[i].pid == pid) {
+				autostartexited(&autostartjobs[i], status);
+				break;
+			}
+}
+
 Monitor *
 recttomon(int x, int y, int w, int h)
 {
@@ -2550,15 +3699,137 @@ restack(Monitor *m)
 	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
 }
 
+/* Returns whether rule 'r' applies to a window of the given class, instance
+ * and title. */
+int
+rulematches(const Rule *r, const char *class, const char *instance, const char *title)
+{
+	return (!r->title || strstr(title, r->title))
+		&& (!r->class || strstr(class, r->class))
+		&& (!r->instance || strstr(instance, r->instance));
+}
+
 void
 run(void)
 {
 	XEvent ev;
+	struct pollfd fds[LENGTH(watches) + 1];
+	Watch *w;
+	int i, n, t, timeout;
+
 	/* main event loop */
 	XSync(dpy, False);
-	while (running && !XNextEvent(dpy, &ev))
-		if (handler[ev.type])
-			handler[ev.type](&ev); /* call handler */
+	while (running) {
+		timeout = runstatusblocks();
+		/* XPending() also flushes requests queued by the handlers */
+		while (running && XPending(dpy)) {
+			XNextEvent(dpy, &ev);
+			if (handler[ev.type])
+				handler[ev.type](&ev); /* call handler */
+		}
+		if (!running)
+			break;
+		ipcnotify(NULL);
+		publishstate();
+		updateewmh();
+		updateclientlist();
+		/* refills the pools, after a pooled window died too */
+		if ((t = poolfill()) != -1 && (timeout == -1 || t < timeout))
+			timeout = t;
+		fds[0].fd = ConnectionNumber(dpy);
+		fds[0].events = POLLIN;
+		for (n = 0; n < nwatches; n++) {
+			fds[n + 1].fd = watches[n].fd;
+			fds[n + 1].events = watches[n].events;
+		}
+		if (poll(fds, n + 1, timeout) == -1) {
+			if (errno == EINTR)
+				continue;
+			die("poll:");
+		}
+		/* the callbacks may change the watch list, look each one up again */
+		for (i = 1; i <= n; i++) {
+			if (!fds[i].revents)
+				continue;
+			for (w = watches; w < watches + nwatches && w->fd != fds[i].fd; w++);
+			if (w < watches + nwatches)
+				w->func(fds[i].fd, fds[i].revents);
+		}
+	}
+}
+
+/* Updates the built-in blocks that are due and returns the milliseconds until
+ * the next one is, or -1 if there is none. */
+int
+runstatusblocks(void)
+{
+	struct timespec now, wall;
+	char text[IPCMAXLINE];
+	const BuiltinBlock *bb;
+	BlockState *st;
+	const char *s;
+	long ms, period, timeout = -1;
+	int n;
+
+	if (!statusengine)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	for (bb = statusblocks, st = blockstate; bb < statusblocks + LENGTH(statusblocks); bb++, st++) {
+		if (st->next <= ms) {
+			if ((s = bb->func(bb->arg, st))) {
+				n = 0;
+				if (bb->id)
+					text[n++] = bb->id;
+				snprintf(text + n, sizeof(text) - n, bb->fmt, s);
+				setstatusblock(bb->name, text);
+			} else {
+				/* e.g. no battery or no such interface, an empty
+				 * block takes no space and keeps its place */
+				setstatusblock(bb->name, "");
+			}
+			/* due at the next multiple of the interval on the wall clock,
+			 * so that a clock turns over on time */
+			clock_gettime(CLOCK_REALTIME, &wall);
+			period = MAX(bb->interval, 1) * 1000;
+			st->next = ms + period - (wall.tv_sec * 1000 + wall.tv_nsec / 1000000) % period;
+		}
+		if (timeout == -1 || st->next - ms < timeout)
+			timeout = st->next - ms;
+	}
+	return timeout;
+}
+
+/* Runs cmd with sh(1) and calls done with the first line it prints, if
+ * any, once it exits. Events keep being handled meanwhile. Only one menu
+ * per done is open at a time. */
+void
+runmenu(const char *cmd, void (*done)(const char *choice))
+{
+	const char *argv[] = { "/bin/sh", "-c", cmd, NULL };
+	Menu *m;
+	pid_t pid;
+	int fds[2];
+
+	for (m = menus; m; m = m->next)
+		if (m->done == done)
+			return;
+	if (nwatches == LENGTH(watches) || pipe(fds) == -1)
+		return;
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	pid = launch(argv, environ, fds[1]);
+	close(fds[1]);
+	if (pid == -1) {
+		close(fds[0]);
+		return;
+	}
+	m = ecalloc(1, sizeof(Menu));
+	m->fd = fds[0];
+	m->done = done;
+	m->next = menus;
+	menus = m;
+	addwatch(m->fd, menuread);
 }
 
 void
@@ -2584,78 +3855,46 @@ rundmenu(const Arg* arg) {
 void
 runautostart(void)
 {
-	char *pathpfx;
-	char *path;
-	char *xdgdatahome;
-	char *home;
+	char pathpfx[PATH_MAX], path[PATH_MAX];
+	const char *xdgdatahome = getenv("XDG_DATA_HOME"), *home = getenv("HOME");
+	const char *scripts[] = { autostartblocksh, autostartsh };
 	struct stat sb;
+	AutostartJob *j;
+	size_t i, k;
 
-	if ((home = getenv("HOME")) == NULL)
-		/* this is almost impossible */
-		return;
+	autostartjobs = ecalloc(LENGTH(scripts) + LENGTH(autostart), sizeof(AutostartJob));
 
 	/* if $XDG_DATA_HOME is set and not empty, use $XDG_DATA_HOME/dwm,
-	 * otherwise use ~/.local/share/dwm as autostart script directory
-	 */
-	xdgdatahome = getenv("XDG_DATA_HOME");
-	if (xdgdatahome != NULL && *xdgdatahome != '\0') {
-		/* space for path segments, separators and nul */
-		pathpfx = ecalloc(1, strlen(xdgdatahome) + strlen(dwmdir) + 2);
-
-		if (sprintf(pathpfx, "%s/%s", xdgdatahome, dwmdir) <= 0) {
-			free(pathpfx);
-			return;
-		}
-	} else {
-		/* space for path segments, separators and nul */
-		pathpfx = ecalloc(1, strlen(home) + strlen(localshare)
-		                     + strlen(dwmdir) + 3);
-
-		if (sprintf(pathpfx, "%s/%s/%s", home, localshare, dwmdir) < 0) {
-			free(pathpfx);
-			return;
-		}
-	}
-
-	/* check if the autostart script directory exists */
-	if (! (stat(pathpfx, &sb) == 0 && S_ISDIR(sb.st_mode))) {
-		/* the XDG conformant path does not exist or is no directory
-		 * so we try ~/.dwm instead
-		 */
-		char *pathpfx_new = realloc(pathpfx, strlen(home) + strlen(dwmdir) + 3);
-		if(pathpfx_new == NULL) {
-			free(pathpfx);
-			return;
-		}
-		pathpfx = pathpfx_new;
-
-		if (sprintf(pathpfx, "%s/.%s", home, dwmdir) <= 0) {
-			free(pathpfx);
-			return;
-		}
-	}
-
-	/* try the blocking script first */
-	path = ecalloc(1, strlen(pathpfx) + strlen(autostartblocksh) + 2);
-	if (sprintf(path, "%s/%s", pathpfx, autostartblocksh) <= 0) {
-		free(path);
-		free(pathpfx);
+	 * otherwise use ~/.local/share/dwm as autostart script directory and
+	 * ~/.dwm if that is no directory either */
+	if (xdgdatahome && *xdgdatahome)
+		i = snprintf(pathpfx, sizeof(pathpfx), "%s/%s", xdgdatahome, dwmdir);
+	else if (home)
+		i = snprintf(pathpfx, sizeof(pathpfx), "%s/%s/%s", home, localshare, dwmdir);
+	else
+		i = sizeof(pathpfx);
+	if (i < sizeof(pathpfx) && !(stat(pathpfx, &sb) == 0 && S_ISDIR(sb.st_mode)))
+		i = home ? snprintf(pathpfx, sizeof(pathpfx), "%s/.%s", home, dwmdir) : sizeof(pathpfx);
+
+	/* the blocking script is a barrier for everything after it */
+	for (k = 0; i < sizeof(pathpfx) && k < LENGTH(scripts); k++) {
+		if (snprintf(path, sizeof(path), "%s/%s", pathpfx, scripts[k]) >= sizeof(path)
+		|| access(path, X_OK) != 0)
+			continue;
+		j = &autostartjobs[nautostartjobs++];
+		j->argv[0] = strcpy(ecalloc(1, strlen(path) + 1), path);
+		j->barrier = scripts[k] == autostartblocksh;
 	}
-
-	if (access(path, X_OK) == 0)
-		system(path);
-
-	/* now the non-blocking script */
-	if (sprintf(path, "%s/%s", pathpfx, autostartsh) <= 0) {
-		free(path);
-		free(pathpfx);
+	for (i = 0; i < LENGTH(autostart) && autostart[i].cmd; i++) {
+		j = &autostartjobs[nautostartjobs++];
+		j->argv[0] = "/bin/sh";
+		j->argv[1] = "-c";
+		j->argv[2] = autostart[i].cmd;
+		j->restart = autostart[i].restart;
+		j->barrier = autostart[i].barrier;
 	}
-
-	if (access(path, X_OK) == 0)
-		system(strcat(path, " &"));
-
-	free(pathpfx);
-	free(path);
+	autostartnext();
+	fprintf(stderr, "dwm: ready after %ldms\n", msince(&starttime));
 }
 
 void
@@ -2787,25 +4026,7 @@ sendmon(Client *c, Monitor *m)
 	detachstack(c);
 	c->mon = m;
 	c->tags = m->tagset[m->seltags]; /* assign tags of target monitor */
-	switch(attachdirection){
-		case 1:
-			attachabove(c);
-			break;
-		case 2:
-			attachaside(c);
-			break;
-		case 3:
-			attachbelow(c);
-			break;
-		case 4:
-			attachbottom(c);
-			break;
-		case 5:
-			attachtop(c);
-			break;
-		default:
-			attach(c);
-	}
+	attachdirected(c);
 	attachstack(c);
 	focus(NULL);
 	arrange(NULL);
@@ -2931,6 +4152,14 @@ setlayout(const Arg *arg)
 		drawbar(selmon);
 }
 
+/* selects layouts[arg->i], for callers that cannot pass a pointer */
+void
+setlayoutex(const Arg *arg)
+{
+	if (arg->i >= 0 && arg->i < LENGTH(layouts) - 1)
+		setlayout(&((Arg){.v = &layouts[arg->i]}));
+}
+
 void
 setcfact(const Arg *arg) {
 	float f;
@@ -2992,15 +4221,76 @@ setmfact(const Arg *arg)
 	arrange(selmon);
 }
 
+/* Sets a named status block, or removes it if text is NULL. Blocks are shown
+ * after the root window name in the order they were first set. */
+const char *
+setstatusblock(const char *name, const char *text)
+{
+	StatusBlock *b;
+	int oldw;
+
+	for (b = blocks + 1; b < blocks + nblocks && strcmp(b->name, name); b++);
+	if (!text) {
+		if (b < blocks + nblocks) {
+			memmove(b, b + 1, (blocks + --nblocks - b) * sizeof(*b));
+			updateblock(NULL, 0);
+		}
+		return NULL;
+	}
+	if (b == blocks + nblocks) {
+		if (nblocks == LENGTH(blocks))
+			return "too many blocks";
+		if (nblocks++ == 1 && !strcmp(blocks[0].text, "dwm-"VERSION)) {
+			/* drop the placeholder shown for an unset root name */
+			blocks[0].text[0] = '\0';
+			measureblock(&blocks[0]);
+		}
+		strcpy(b->name, name);
+		b->w = -1; /* forces a full redraw */
+	} else if (!strcmp(b->text, text)) {
+		return NULL;
+	}
+	oldw = b->w;
+	strncpy(b->text, text, sizeof(b->text) - 1);
+	measureblock(b);
+	updateblock(b, oldw);
+	return NULL;
+}
+
 void
 setup(void)
 {
 	int i;
+	size_t n;
+	long ndesk;
+	char *desknames;
+	struct sigaction sa;
 	XSetWindowAttributes wa;
 	Atom utf8string;
 
+	/* the environment of statuscmds, spawn() fills in BUTTON */
+	for (n = 0; environ[n]; n++);
+	statusenv = ecalloc(n + 2, sizeof(char *));
+	for (n = i = 0; environ[i]; i++)
+		if (strncmp(environ[i], "BUTTON=", 7))
+			statusenv[n++] = environ[i];
+	statusenv[n] = buttonenv;
+
+	/* children are reaped by the main loop */
+	if (pipe(sigchldpipe) == -1)
+		die("pipe:");
+	for (i = 0; i < 2; i++) {
+		fcntl(sigchldpipe[i], F_SETFD, FD_CLOEXEC);
+		fcntl(sigchldpipe[i], F_SETFL, O_NONBLOCK);
+	}
+	sa.sa_handler = sigchld;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_NOCLDSTOP | SA_RESTART;
+	if (sigaction(SIGCHLD, &sa, NULL) == -1)
+		die("can't install SIGCHLD handler:");
+	addwatch(sigchldpipe[0], reapchildren);
 	/* clean up any zombies immediately */
-	sigchld(0);
+	reapchildren(sigchldpipe[0], POLLIN);
 
 	signal(SIGHUP, sighup);
 	signal(SIGTERM, sigterm);
@@ -3014,6 +4304,21 @@ setup(void)
 	drw = drw_create(dpy, screen, root, sw, sh, visual, depth, cmap);
 	if (!drw_fontset_create(drw, fonts, LENGTH(fonts)))
 		die("no fonts could be loaded.");
+	drw_setbatch(drw, batchdraw);
+	drw->fontsready = fontsready;
+	if ((i = worker_start()) != -1)
+		addwatch(i, workerready);
+	/* have the fallback fonts for the static bar strings looked up while
+	 * the rest of the startup runs */
+	for (i = 0; i < LENGTH(tags); i++)
+		drw_fontset_prewarm(drw, tags[i]);
+	for (i = 0; i < LENGTH(layouts); i++)
+		drw_fontset_prewarm(drw, layouts[i].symbol);
+	drw_fontset_prewarm(drw, swalsymbol);
+	ipcsetup();
+	setupstate();
+	for (i = 0; i < LENGTH(blockstate); i++)
+		blockstate[i].fd[0] = blockstate[i].fd[1] = -1;
 	lrpad = drw->fonts->h;
 	bh = user_bh ? user_bh : drw->fonts->h + 2;
 	updategeom();
@@ -3042,6 +4347,12 @@ setup(void)
 	netatom[NetWMWindowTypeDock] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DOCK", False);
 	netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
 	netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	netatom[NetClientListStacking] = XInternAtom(dpy, "_NET_CLIENT_LIST_STACKING", False);
+	netatom[NetNumberOfDesktops] = XInternAtom(dpy, "_NET_NUMBER_OF_DESKTOPS", False);
+	netatom[NetCurrentDesktop] = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
+	netatom[NetDesktopNames] = XInternAtom(dpy, "_NET_DESKTOP_NAMES", False);
+	netatom[NetWMDesktop] = XInternAtom(dpy, "_NET_WM_DESKTOP", False);
+	netatom[NetWMPid] = XInternAtom(dpy, "_NET_WM_PID", False);
 	xatom[Manager] = XInternAtom(dpy, "MANAGER", False);
 	xatom[Xembed] = XInternAtom(dpy, "_XEMBED", False);
 	xatom[XembedInfo] = XInternAtom(dpy, "_XEMBED_INFO", False);
@@ -3060,6 +4371,7 @@ setup(void)
 	tagscheme = ecalloc(LENGTH(tagsel), sizeof(Clr *));
 	for (i = 0; i < LENGTH(tagsel); i++)
 		tagscheme[i] = drw_scm_create(drw, tagsel[i], tagalpha, 2);
+	updatetagcells();
 	/* init system tray */
 	if (showsystray)
 		updatesystray(0);
@@ -3079,6 +4391,19 @@ setup(void)
 	XChangeProperty(dpy, root, netatom[NetSupported], XA_ATOM, 32,
 		PropModeReplace, (unsigned char *) netatom, NetLast);
 	XDeleteProperty(dpy, root, netatom[NetClientList]);
+	XDeleteProperty(dpy, root, netatom[NetClientListStacking]);
+	/* tags are desktops, a client on several of them is on the first */
+	ndesk = LENGTH(tags);
+	XChangeProperty(dpy, root, netatom[NetNumberOfDesktops], XA_CARDINAL, 32,
+		PropModeReplace, (unsigned char *) &ndesk, 1);
+	for (i = 0, n = 0; i < LENGTH(tags); i++)
+		n += strlen(tags[i]) + 1;
+	desknames = ecalloc(n, 1);
+	for (i = 0, n = 0; i < LENGTH(tags); i++)
+		n += strlen(strcpy(desknames + n, tags[i])) + 1;
+	XChangeProperty(dpy, root, netatom[NetDesktopNames], utf8string, 8,
+		PropModeReplace, (unsigned char *) desknames, n);
+	free(desknames);
 	/* select events */
 	wa.cursor = cursor[CurNormal]->cursor;
 	wa.event_mask = SubstructureRedirectMask|SubstructureNotifyMask
@@ -3104,6 +4429,33 @@ seturgent(Client *c, int urg)
 	XFree(wmh);
 }
 
+void
+setupstate(void)
+{
+	const char *display = getenv("DISPLAY");
+	void *p;
+	int fd;
+
+	if (!sharedstate)
+		return;
+	snprintf(statename, sizeof(statename), DWMSTATE_NAME, (unsigned int)getuid(),
+		display ? display : "");
+	shm_unlink(statename); /* left over by a crash, readers may still map it */
+	if ((fd = shm_open(statename, O_RDWR | O_CREAT | O_EXCL, 0600)) == -1) {
+		perror("dwm: shm_open");
+		return;
+	}
+	if (ftruncate(fd, sizeof(DwmState)) == -1
+	|| (p = mmap(NULL, sizeof(DwmState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		perror("dwm: shared state");
+		shm_unlink(statename);
+		close(fd);
+		return;
+	}
+	close(fd);
+	statemap = p;
+}
+
 void
 showhide(Client *c)
 {
@@ -3123,12 +4475,15 @@ showhide(Client *c)
 	}
 }
 
+/* Wakes up the main loop, which reaps the children in reapchildren(). */
 void
 sigchld(int unused)
 {
-	if (signal(SIGCHLD, sigchld) == SIG_ERR)
-		die("can't install SIGCHLD handler:");
-	while (0 < waitpid(-1, NULL, WNOHANG));
+	int e = errno;
+
+	/* a full pipe already means a wakeup is pending */
+	while (write(sigchldpipe[1], "", 1) == -1 && errno == EINTR);
+	errno = e;
 }
 
 void
@@ -3148,27 +4503,20 @@ sigterm(int unused)
 void
 spawn(const Arg *arg)
 {
+	int i;
+
 	if (arg->v == dmenucmd)
 		dmenumon[0] = '0' + selmon->num;
-	if (fork() == 0) {
-		if (dpy)
-			close(ConnectionNumber(dpy));
-		if (arg->v == statuscmd) {
-			for (int i = 0; i < LENGTH(statuscmds); i++) {
-				if (statuscmdn == statuscmds[i].id) {
-					statuscmd[2] = statuscmds[i].cmd;
-					setenv("BUTTON", lastbutton, 1);
-					break;
-				}
-			}
-			if (!statuscmd[2])
-				exit(EXIT_SUCCESS);
+	if (arg->v == statuscmd) {
+		for (i = 0; i < LENGTH(statuscmds) && statuscmds[i].id != statuscmdn; i++);
+		if (i < LENGTH(statuscmds)) {
+			const char *argv[] = { statuscmd[0], statuscmd[1], statuscmds[i].cmd, NULL };
+
+			buttonenv[7] = *lastbutton;
+			launch(argv, statusenv, -1);
 		}
-		setsid();
-		execvp(((char **)arg->v)[0], (char **)arg->v);
-		fprintf(stderr, "dwm: execvp %s", ((char **)arg->v)[0]);
-		perror(" failed");
-		exit(EXIT_SUCCESS);
+	} else {
+		launch(arg->v, environ, -1);
 	}
 }
 
@@ -3189,6 +4537,19 @@ systraytomon(Monitor *m)
 	return t;
 }
 
+/* Terminates the entries dwm restarts, a new dwm starts its own. Each was
+ * launched in a session of its own, so the whole process group is
+ * signalled, not only the shell running the command. */
+void
+stopautostart(void)
+{
+	size_t i;
+
+	for (i = 0; i < nautostartjobs; i++)
+		if (autostartjobs[i].restart && autostartjobs[i].pid > 0)
+			kill(-autostartjobs[i].pid, SIGTERM);
+}
+
 /*
  * Perform immediate swallow of client 'swee' by client 'swer'. 'manage' shall
  * be set if swal() is called from swalmanage(). 'swer' and 'swee' must be
@@ -3258,40 +4619,22 @@ swal(Client *swer, Client *swee, int manage)
 /*
  * Register a future swallow with swallower. 'c' 'class', 'inst' and 'title'
  * shall point null-terminated strings or be NULL, implying a wildcard. If an
- * already existing swallow instance targets 'c' its filters are updated and no
- * new swallow instance is created. 'c' may be ClientRegular or ClientSwallowee.
- * Complement to swalrm().
+ * already existing swallow instance targets 'c' it is replaced, so that at
+ * most one swallow instance targets a client. 'c' may be ClientRegular or
+ * ClientSwallowee. Complement to swalrm().
  */
 void swalreg(Client *c, const char *class, const char *inst, const char *title)
 {
-	Swallow *s;
+	Swallow *s, **b;
 
 	if (!c)
 		return;
 
-	for (s = swallows; s; s = s->next) {
-		if (s->client == c) {
-			if (class)
-				strncpy(s->class, class, sizeof(s->class) - 1);
-			else
-				s->class[0] = '\0';
-			if (inst)
-				strncpy(s->inst, inst, sizeof(s->inst) - 1);
-			else
-				s->inst[0] = '\0';
-			if (title)
-				strncpy(s->title, title, sizeof(s->title) - 1);
-			else
-				s->title[0] = '\0';
-			s->decay = swaldecay;
-
-			/* Only one swallow per client. May return after first hit. */
-			return;
-		}
-	}
+	if ((s = swalfind(c)))
+		swalrm(s);
 
 	s = ecalloc(1, sizeof(Swallow));
-	s->decay = swaldecay;
+	s->expires = swalmaps + swaldecay;
 	s->client = c;
 	if (class)
 		strncpy(s->class, class, sizeof(s->class) - 1);
@@ -3300,25 +4643,80 @@ void swalreg(Client *c, const char *class, const char *inst, const char *title)
 	if (title)
 		strncpy(s->title, title, sizeof(s->title) - 1);
 
-	s->next = swallows;
-	swallows = s;
+	b = swalbucket(s->class);
+	s->next = *b;
+	*b = s;
+	s->older = swalnewest;
+	if (swalnewest)
+		swalnewest->newer = s;
+	else
+		swaloldest = s;
+	swalnewest = s;
+	nswallows++;
+}
+
+/*
+ * Return the bucket of swallow instances registered with class name 'class'.
+ * Instances with an empty class share the last bucket.
+ */
+Swallow **
+swalbucket(const char *class)
+{
+	unsigned int h = 5381;
+
+	if (!*class)
+		return &swalbuckets[SWALBUCKETS];
+	while (*class)
+		h = h * 33 + (unsigned char)*class++;
+	return &swalbuckets[h & (SWALBUCKETS - 1)];
 }
 
 /*
- * Decrease decay counter of all registered swallows by 'decayby' and remove any
- * swallow instances whose counter is less than or equal to zero.
+ * Count a mapped window and remove the swallow instances which have seen
+ * 'swaldecay' windows mapped without having been consumed. Instances expire
+ * in the order they were registered in.
  */
 void
-swaldecayby(int decayby)
+swalexpire(void)
 {
-	Swallow *s, *t;
+	swalmaps++;
+	while (swaloldest && swaloldest->expires <= swalmaps)
+		swalrm(swaloldest);
+}
 
-	for (s = swallows; s; s = t) {
-		s->decay -= decayby;
-		t = s->next;
-		if (s->decay <= 0)
-			swalrm(s);
-	}
+/*
+ * Return the swallow instance targeting 'c', or NULL if there is none.
+ */
+Swallow *
+swalfind(Client *c)
+{
+	Swallow *s;
+
+	for (s = swaloldest; s && s->client != c; s = s->newer);
+	return s;
+}
+
+/*
+ * Return whether rules let window 'w' of class 'class' and instance
+ * 'instance' swallow the terminal it was started from. Dialogs, terminals and
+ * windows of noswallow rules never do.
+ */
+int
+swalallowed(Window w, const char *class, const char *instance)
+{
+	char title[256];
+	unsigned int i;
+	Window trans;
+
+	if (XGetTransientForHint(dpy, w, &trans))
+		return 0;
+	if (!gettextprop(w, netatom[NetWMName], title, sizeof(title)))
+		gettextprop(w, XA_WM_NAME, title, sizeof(title));
+	for (i = 0; i < LENGTH(rules); i++)
+		if (rulematches(&rules[i], class, instance, title)
+		&& (rules[i].isterminal || rules[i].noswallow))
+			return 0;
+	return 1;
 }
 
 /*
@@ -3326,19 +4724,17 @@ swaldecayby(int decayby)
  * swallowed immediately. Pendant to manage() for such windows.
  */
 void
-swalmanage(Swallow *s, Window w, XWindowAttributes *wa)
+swalmanage(Client *swer, Window w, XWindowAttributes *wa)
 {
-	Client *swee, *swer;
+	Client *swee;
 	XWindowChanges wc;
 
-	swer = s->client;
-	swalrm(s);
-
 	/* Perform bare minimum setup of a client for window 'w' such that swal()
 	 * may be used to perform the swallow. The following lines are basically a
 	 * minimal implementation of manage() with a few chunks delegated to
 	 * swal(). */
 	swee = ecalloc(1, sizeof(Client));
+	swee->netdesk = -2;
 	swee->win = w;
 	swee->mon = swer->mon;
 	swee->oldbw = wa->border_width;
@@ -3351,39 +4747,52 @@ swalmanage(Swallow *s, Window w, XWindowAttributes *wa)
 	wc.border_width = swee->bw;
 	XConfigureWindow(dpy, swee->win, CWBorderWidth, &wc);
 	grabbuttons(swee, 0);
-	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
-		(unsigned char *) &(swee->win), 1);
+	clientlistadd(swee->win);
 
 	swal(swer, swee, 1);
 }
 
 /*
  * Return swallow instance which targets window 'w' as determined by its class
- * name, instance name and window title. Returns NULL if none is found. Pendant
- * to wintoclient().
+ * name, instance name and window title. Instances registered with the
+ * window's class take precedence over those for any class. Returns NULL if
+ * none is found. Pendant to wintoclient(). The class hint is read into 'ch'
+ * if it is still empty, the caller frees it.
  */
 Swallow *
-swalmatch(Window w)
+swalmatch(Window w, XClassHint *ch)
 {
-	XClassHint ch = { NULL, NULL };
-	Swallow *s = NULL;
+	Swallow *s = NULL, **b;
 	char title[sizeof(s->title)];
-
-	XGetClassHint(dpy, w, &ch);
-	if (!gettextprop(w, netatom[NetWMName], title, sizeof(title)))
-		gettextprop(w, XA_WM_NAME, title, sizeof(title));
-
-	for (s = swallows; s; s = s->next) {
-		if ((!ch.res_class || strstr(ch.res_class, s->class))
-			&& (!ch.res_name || strstr(ch.res_name, s->inst))
-			&& (title[0] == '\0' || strstr(title, s->title)))
-			break;
+	int i, fetched = 0;
+
+	/* spare the round trips for the common case */
+	if (!nswallows)
+		return NULL;
+
+	if (!ch->res_class && !ch->res_name)
+		XGetClassHint(dpy, w, ch);
+	b = ch->res_class && *ch->res_class ? swalbucket(ch->res_class) : NULL;
+	for (i = 0; i <= SWALBUCKETS && !s; i++) {
+		/* a window without WM_CLASS passes any class filter, all buckets
+		 * are searched for it */
+		if (ch->res_class && i < SWALBUCKETS && &swalbuckets[i] != b)
+			continue;
+		for (s = swalbuckets[i]; s; s = s->next) {
+			if ((ch->res_class && i < SWALBUCKETS && strcmp(ch->res_class, s->class))
+				|| (*s->inst && ch->res_name && strcmp(ch->res_name, s->inst)))
+				continue;
+			if (!*s->title)
+				break;
+			/* the title is only fetched for an instance filtering by it */
+			if (!fetched && !gettextprop(w, netatom[NetWMName], title, sizeof(title)))
+				gettextprop(w, XA_WM_NAME, title, sizeof(title));
+			fetched = 1;
+			if (title[0] == '\0' || strstr(title, s->title))
+				break;
+		}
 	}
 
-	if (ch.res_class)
-		XFree(ch.res_class);
-	if (ch.res_name)
-		XFree(ch.res_name);
 	return s;
 }
 
@@ -3425,26 +4834,67 @@ swalmouse(const Arg *arg)
 }
 
 /*
- * Delete swallow instance swallows and free its resources. Complement to
- * swalreg(). If NULL is passed all swallows are deleted from.
+ * Return the terminal client which started the process owning window 'w',
+ * found through _NET_WM_PID and the parents of that process, if 'w' shall
+ * swallow it. Returns NULL otherwise. 'ch' is handled as by swalmatch().
+ */
+Client *
+swalterminal(Window w, XClassHint *ch)
+{
+	Client *c = NULL;
+	Monitor *m;
+	pid_t pid, p;
+	int depth;
+
+	/* no round trips while there is no terminal to swallow */
+	for (m = mons; m && !c; m = m->next)
+		for (c = m->clients; c && !(c->isterminal && c->pid); c = c->next);
+	if (!c || !(pid = getwinpid(w)))
+		return NULL;
+
+	for (c = NULL, p = pid, depth = 0; !c && depth < 32 && (p = getparentprocess(p, 0)) > 1; depth++)
+		for (m = mons; m && !c; m = m->next)
+			for (c = m->clients; c && !(c->isterminal && c->pid == p); c = c->next);
+	if (!c)
+		return NULL;
+	/* the cached ancestors may be of processes gone by now whose pids
+	 * were reused, confirm them before swallowing */
+	for (p = pid; depth-- && (p = getparentprocess(p, 1)) > 1 && p != c->pid;);
+	if (p != c->pid)
+		return NULL;
+	if (!ch->res_class && !ch->res_name)
+		XGetClassHint(dpy, w, ch);
+	return swalallowed(w, ch->res_class ? ch->res_class : broken,
+		ch->res_name ? ch->res_name : broken) ? c : NULL;
+}
+
+/*
+ * Delete swallow instance 's' and free its resources. Complement to
+ * swalreg(). If NULL is passed all swallows are deleted.
  */
 void
 swalrm(Swallow *s)
 {
-	Swallow *t, **ps;
+	Swallow **ps;
 
-	if (s) {
-		for (ps = &swallows; *ps && *ps != s; ps = &(*ps)->next);
-		*ps = s->next;
-		free(s);
-	}
-	else {
-		for(s = swallows; s; s = t) {
-			t = s->next;
-			free(s);
-		}
-		swallows = NULL;
+	if (!s) {
+		while (swaloldest)
+			swalrm(swaloldest);
+		return;
 	}
+
+	for (ps = swalbucket(s->class); *ps != s; ps = &(*ps)->next);
+	*ps = s->next;
+	if (s->older)
+		s->older->newer = s->newer;
+	else
+		swaloldest = s->newer;
+	if (s->newer)
+		s->newer->older = s->older;
+	else
+		swalnewest = s->older;
+	nswallows--;
+	free(s);
 }
 
 /*
@@ -3452,13 +4902,8 @@ swalrm(Swallow *s)
  */
 void swalunreg(Client *c) { Swallow *s;
 
-	for (s = swallows; s; s = s->next) {
-		if (c == s->client) {
-			swalrm(s);
-			/* Max. 1 registered swallow per client. No need to continue. */
-			break;
-		}
-	}
+	if (nswallows && (s = swalfind(c)))
+		swalrm(s);
 }
 
 /*
@@ -3817,6 +5262,19 @@ tag(const Arg *arg)
 	}
 }
 
+void
+tagall(const Arg *arg)
+{
+	tag(&((Arg){.ui = ~0}));
+}
+
+void
+tagex(const Arg *arg)
+{
+	if (arg->ui < LENGTH(tags))
+		tag(&((Arg){.ui = 1 << arg->ui}));
+}
+
 void
 tagmon(const Arg *arg)
 {
@@ -3922,6 +5380,13 @@ toggletag(const Arg *arg)
 	}
 }
 
+void
+toggletagex(const Arg *arg)
+{
+	if (arg->ui < LENGTH(tags))
+		toggletag(&((Arg){.ui = 1 << arg->ui}));
+}
+
 void
 toggleview(const Arg *arg)
 {
@@ -3958,13 +5423,134 @@ toggleview(const Arg *arg)
 	}
 }
 
+void
+toggleviewex(const Arg *arg)
+{
+	if (arg->ui < LENGTH(tags))
+		toggleview(&((Arg){.ui = 1 << arg->ui}));
+}
+
+/* Drops the least recently drawn icon not currently on any bar, clients
+ * using it reload it when they are shown again. Icons with references
+ * outside of the clients, swallowed ones included, cannot be dropped and
+ * are passed over. */
+void
+evicticon(void)
+{
+	Icon *i, *lru = NULL;
+	Monitor *m;
+	Client *c, *d;
+	unsigned int n;
+
+	for (i = icons; i; i = i->next) {
+		if (i->pending || (lru && i->used >= lru->used))
+			continue;
+		for (m = mons; m && !(m->sel && m->sel->iconref == i); m = m->next);
+		if (!m && iconusers(i) == i->refs)
+			lru = i;
+	}
+	if (!lru)
+		return;
+	n = lru->refs;
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			for (d = c; d; d = d->swallowedby)
+				if (d->iconref == lru) {
+					freeicon(d);
+					d->iconstale = 1;
+					if (!--n)
+						return;
+				}
+}
+
+/* Text measured while a fallback font was still being looked up used a
+ * placeholder glyph, everything derived from such widths is redone. */
+void
+fontsready(Drw *d)
+{
+	int i;
+
+	updatetagcells();
+	for (i = 1; i < nblocks; i++)
+		measureblock(&blocks[i]);
+	updatestatus();
+	drawbars();
+}
+
+void
+iconjobrun(Job *job)
+{
+	IconJob *j = (IconJob *)job;
+
+	j->scaled = drw_picture_scale(j->px, j->w, j->h, j->dstw, j->dsth);
+}
+
+void
+iconjobdone(Job *job)
+{
+	IconJob *j = (IconJob *)job;
+	Icon *icon = j->icon;
+	Monitor *m;
+	Client *c, *d;
+
+	if (icon->refs) {
+		icon->pic = drw_picture_create(drw, j->scaled, j->dstw, j->dsth);
+		icon->pending = 0;
+		for (m = mons; m; m = m->next) {
+			/* swallowed clients get it too, to show once they are back */
+			for (c = m->clients; c; c = c->next)
+				for (d = c; d; d = d->swallowedby)
+					if (d->iconref == icon)
+						d->icon = icon->pic;
+			if (m->sel && m->sel->iconref == icon)
+				drawbar(m);
+		}
+	} else {
+		/* released while it was being scaled */
+		free(icon->src);
+		free(icon);
+	}
+	if (j->scaled != j->px)
+		free(j->scaled);
+	free(j->px);
+	free(j);
+}
+
+/* Returns the number of clients using icon, swallowed ones included. */
+unsigned int
+iconusers(Icon *icon)
+{
+	Monitor *m;
+	Client *c, *d;
+	unsigned int n = 0;
+
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next)
+			for (d = c; d; d = d->swallowedby)
+				n += d->iconref == icon;
+	return n;
+}
+
 void
 freeicon(Client *c)
 {
-	if (c->icon) {
-		XRenderFreePicture(dpy, c->icon);
-		c->icon = None;
+	Icon **ip;
+
+	if (!c->iconref)
+		return;
+	if (!--c->iconref->refs) {
+		for (ip = &icons; *ip != c->iconref; ip = &(*ip)->next);
+		*ip = c->iconref->next;
+		nicons--;
+		/* a pending icon is freed by iconjobdone() */
+		if (!c->iconref->pending) {
+			XRenderFreePicture(dpy, c->iconref->pic);
+			free(c->iconref->src);
+			free(c->iconref);
+		}
 	}
+	c->iconref = NULL;
+	c->icon = None;
 }
 
 void
@@ -3991,6 +5577,8 @@ unmanage(Client *c, int destroyed)
 
 	/* Remove all swallow instances targeting client. */
 	swalunreg(c);
+	if (!c->pool)
+		ipcemit(NULL, IPCEvClient, "unmap" IPCSEP "0x%lx", c->win);
 
 	if (c == mark)
 		setmark(0);
@@ -4004,6 +5592,7 @@ unmanage(Client *c, int destroyed)
 		XSetErrorHandler(xerrordummy);
 		XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
 		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
+		XDeleteProperty(dpy, c->win, netatom[NetWMDesktop]);
 		setclientstate(c, WithdrawnState);
 		XSync(dpy, False);
 		XSetErrorHandler(xerror);
@@ -4011,9 +5600,9 @@ unmanage(Client *c, int destroyed)
 	}
 	if (scratchpad_last_showed == c)
 		scratchpad_last_showed = NULL;
+	clientlistdel(c->win);
 	free(c);
 	focus(NULL);
-	updateclientlist();
 	arrange(m);
 }
 
@@ -4092,22 +5681,83 @@ updatebarpos(Monitor *m)
 		m->by = -bh - vp;
 }
 
+/* Writes _NET_CLIENT_LIST in a single request if a client came or went
+ * since the last call. run() calls it after each batch of events. */
+void
+updateclientlist(void)
+{
+	if (!clientlistdirty)
+		return;
+	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32,
+		PropModeReplace, (unsigned char *) clientlist, nclientlist);
+	clientlistdirty = 0;
+}
+
+/* Brings the EWMH desktop and stacking properties up to date, writing only
+ * those which changed. run() calls it after each batch of events. */
 void
-updateclientlist()
+updateewmh(void)
 {
 	Client *c, *d;
 	Monitor *m;
+	Window w, *tmp;
+	size_t n = 0, seg, i, j;
+	long desk;
+	int floating;
 
-	XDeleteProperty(dpy, root, netatom[NetClientList]);
+	desk = ffs(selmon->tagset[selmon->seltags]) - 1;
+	if (desk != netcurdesk) {
+		XChangeProperty(dpy, root, netatom[NetCurrentDesktop], XA_CARDINAL, 32,
+			PropModeReplace, (unsigned char *) &desk, 1);
+		netcurdesk = desk;
+	}
+
+	/* bottom to top: per monitor the tiled, then the floating clients,
+	 * each least recently focused first, as restack() leaves them */
 	for (m = mons; m; m = m->next) {
-		for (c = m->clients; c; c = c->next) {
-			for (d = c; d; d = d->swallowedby) {
-				XChangeProperty(dpy, root, netatom[NetClientList],
-					XA_WINDOW, 32, PropModeAppend,
-					(unsigned char *) &(c->win), 1);
+		for (floating = 0; floating < 2; floating++) {
+			seg = n;
+			for (c = m->stack; c; c = c->snext) {
+				/* pooled windows are not listed until claimed */
+				if (!c->isfloating != !floating || c->pool)
+					continue;
+				/* scratchpad windows are on no desktop */
+				if (!(c->tags & TAGMASK))
+					desk = -2;
+				else
+					desk = (c->tags & TAGMASK) == TAGMASK ? -1 : ffs(c->tags & TAGMASK) - 1;
+				for (d = c; d; d = d->swallowedby) {
+					if (d->netdesk != desk) {
+						if (desk == -2)
+							XDeleteProperty(dpy, d->win, netatom[NetWMDesktop]);
+						else
+							XChangeProperty(dpy, d->win, netatom[NetWMDesktop], XA_CARDINAL, 32,
+								PropModeReplace, (unsigned char *) &desk, 1);
+						d->netdesk = desk;
+					}
+					if (n == netstackingsize) {
+						netstackingsize = netstackingsize ? 2 * netstackingsize : 64;
+						netstacking = erealloc(netstacking, netstackingsize * sizeof(Window));
+						netstackingnext = erealloc(netstackingnext, netstackingsize * sizeof(Window));
+					}
+					netstackingnext[n++] = d->win;
+				}
+			}
+			for (i = seg, j = n; j - i > 1; i++, j--) {
+				w = netstackingnext[i];
+				netstackingnext[i] = netstackingnext[j - 1];
+				netstackingnext[j - 1] = w;
 			}
 		}
 	}
+	if (n == nnetstacking && !memcmp(netstacking, netstackingnext, n * sizeof(Window)))
+		return;
+	XChangeProperty(dpy, root, netatom[NetClientListStacking], XA_WINDOW, 32,
+		PropModeReplace, (unsigned char *) netstackingnext, n);
+	tmp = netstacking;
+	netstacking = netstackingnext;
+	netstackingnext = tmp;
+	nnetstacking = n;
 }
 
 int
@@ -4265,27 +5915,33 @@ updatesizehints(Client *c)
 	c->isfixed = (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
 }
 
+/* Places the blocks after b changed or, with b NULL, after one went away.
+ * As long as the width stays, b is redrawn alone. */
 void
-updatestatus(void)
+updateblock(StatusBlock *b, int oldw)
 {
-	if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext))) {
-		strcpy(stext, "dwm-"VERSION);
-		statusw = TEXTW(stext) - lrpad + 2;
-	} else {
-		char *text, *s, ch;
-		statusw = 0;
-		for (text = s = stext; *s; s++) {
-			if ((unsigned char)(*s) < ' ') {
-				ch = *s;
-				*s = '\0';
-				statusw += TEXTW(text) - lrpad;
-				*s = ch;
-				text = s + 1;
-			}
-		}
-		statusw += TEXTW(text) - lrpad + 2;
+	int i, x = 0;
+
+	for (i = 0; i < nblocks; i++) {
+		blocks[i].x = x;
+		x += blocks[i].w;
 	}
-	drawbar(selmon);
+	statusw = x;
+	if (b && b->w == oldw)
+		drawstatusblock(b);
+	else
+		drawbar(selmon);
+}
+
+void
+updatestatus(void)
+{
+	int oldw = blocks[0].w;
+
+	if (!gettextprop(root, XA_WM_NAME, blocks[0].text, sizeof(blocks[0].text)))
+		strcpy(blocks[0].text, nblocks > 1 ? "" : "dwm-"VERSION);
+	measureblock(&blocks[0]);
+	updateblock(&blocks[0], oldw);
 }
 
 void
@@ -4347,6 +6003,7 @@ updatesystray(int updatebar)
 		if (i->mon != m)
 			i->mon = m;
 	}
+	systrayw = w ? w + systrayspacing : 0;
 	w = w ? w + systrayspacing : 1;
 	x -= w;
 	XMoveResizeWindow(dpy, systray->win, x - xpad, m->by + ypad, w, bh);
@@ -4417,6 +6074,65 @@ updatesystrayiconstate(Client *i, XPropertyEvent *ev)
 			systray->win, XEMBED_EMBEDDED_VERSION);
 }
 
+/* Width of status text as drawn by drawstatusbar(), i.e. without the
+ * status2d codes but including their ^f^ advances. */
+int
+textw2d(char *text)
+{
+	int i = -1, w = 0, isCode = 0;
+
+	while (text[++i]) {
+		if (text[i] == '^') {
+			if (!isCode) {
+				isCode = 1;
+				text[i] = '\0';
+				w += TEXTW(text) - lrpad;
+				text[i] = '^';
+				if (text[++i] == 'f')
+					w += atoi(text + ++i);
+			} else {
+				isCode = 0;
+				text = text + i + 1;
+				i = -1;
+			}
+		}
+	}
+	if (!isCode)
+		w += TEXTW(text) - lrpad;
+	return w;
+}
+
+/* Pre-renders every tag in every state drawbar() can show it in, so the tag
+ * strip is a handful of copies instead of text draws. Must be called again
+ * whenever the tag symbols, fonts, bar height or tag colours change. */
+void
+updatetagcells(void)
+{
+	int boxs = drw->fonts->h / 9;
+	int boxw = drw->fonts->h / 6 + 2;
+	unsigned int i, cell, x;
+	Drawable prev;
+
+	for (i = tagsw = 0; i < LENGTH(tags); i++) {
+		tagx[i] = tagsw;
+		tagsw += tagw[i] = TEXTW(tags[i]);
+	}
+	if (tagcells)
+		XFreePixmap(dpy, tagcells);
+	tagcells = XCreatePixmap(dpy, root, tagsw, TagCellLast * bh, depth);
+	prev = drw_settarget(drw, tagcells);
+	for (cell = 0; cell < TagCellLast; cell++) {
+		for (i = 0, x = 0; i < LENGTH(tags); x += tagw[i++]) {
+			drw_setscheme(drw, cell & TagCellSel ? tagscheme[i] : scheme[SchemeNorm]);
+			drw_text(drw, x, cell * bh, tagw[i], bh, lrpad / 2, tags[i], cell & TagCellUrg);
+			if (cell & (TagCellOcc | TagCellOccSel))
+				drw_rect(drw, x + boxs, cell * bh + boxs, boxw, boxw,
+					cell & TagCellOccSel, cell & TagCellUrg);
+		}
+	}
+	drw_settarget(drw, prev);
+}
+
 void
 updatetitle(Client *c)
 {
@@ -4429,8 +6145,16 @@ updatetitle(Client *c)
 void
 updateicon(Client *c)
 {
+	/* take the new reference first, an unchanged icon is then a no-op */
+	Icon *icon = geticonprop(c->win);
+
+	c->iconstale = 0;
 	freeicon(c);
-	c->icon = geticonprop(c->win, &c->icw, &c->ich);
+	if ((c->iconref = icon)) {
+		c->icon = icon->pic;
+		c->icw = icon->w;
+		c->ich = icon->h;
+	}
 }
 
 void
@@ -4464,6 +6188,15 @@ updatewmhints(Client *c)
 	}
 }
 
+long
+usince(const struct timespec *t)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) * 1000000 + (now.tv_nsec - t->tv_nsec) / 1000;
+}
+
 void
 view(const Arg *arg)
 {
@@ -4502,6 +6235,19 @@ view(const Arg *arg)
 	arrange(selmon);
 }
 
+void
+viewall(const Arg *arg)
+{
+	view(&((Arg){.ui = ~0}));
+}
+
+void
+viewex(const Arg *arg)
+{
+	if (arg->ui < LENGTH(tags))
+		view(&((Arg){.ui = 1 << arg->ui}));
+}
+
 void
 viewnext(const Arg *arg)
 {
@@ -4514,6 +6260,12 @@ viewprev(const Arg *arg)
 	view(&(const Arg){.ui = prevtag()});
 }
  
+void
+workerready(int fd, short revents)
+{
+	worker_drain();
+}
+
 Client *
 wintoclient(Window w)
 {
@@ -4755,6 +6507,7 @@ load_xresources(void)
 int
 main(int argc, char *argv[])
 {
+	clock_gettime(CLOCK_MONOTONIC, &starttime);
 	if (argc == 2 && !strcmp("-v", argv[1]))
 		die("dwm-"VERSION);
 	else if (argc != 1)
@@ -4774,7 +6527,10 @@ main(int argc, char *argv[])
 	scan();
 	restoreSession();
 	runautostart();
+	poolfill();
 	run();
+	stopautostart();
+	poolkill();
 	if(restart) execvp(argv[0], argv);
 	cleanup();
 	XCloseDisplay(dpy);
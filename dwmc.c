@@ -1,42 +1,93 @@
-void
-setlayoutex(const Arg *arg)
-{
-	setlayout(&((Arg) { .v = &layouts[arg->i] }));
-}
+/* See LICENSE file for copyright and license details.
+ *
+ * dwmc sends its arguments as one command line to the running dwm and
+ * reports the answer, see ipc.h for the protocol. Results of queries go to
+ * stdout. After a successful subscribe it copies the event lines to stdout
+ * until dwm goes away.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
-void
-viewex(const Arg *arg)
-{
-	view(&((Arg) { .ui = 1 << arg->ui }));
-}
+#include "ipc.h"
 
-void
-viewall(const Arg *arg)
+static void
+die(const char *msg)
 {
-	view(&((Arg){.ui = ~0}));
+	fprintf(stderr, "dwmc: %s\n", msg);
+	exit(1);
 }
 
-void
-toggleviewex(const Arg *arg)
+int
+main(int argc, char *argv[])
 {
-	toggleview(&((Arg) { .ui = 1 << arg->ui }));
-}
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const char *dir = getenv("XDG_RUNTIME_DIR"), *display = getenv("DISPLAY");
+	char line[IPCMAXLINE], *p;
+	size_t len = 0, n;
+	ssize_t r;
+	int fd, i;
 
-void
-tagex(const Arg *arg)
-{
-	tag(&((Arg) { .ui = 1 << arg->ui }));
-}
+	if (argc < 2 || !strcmp(argv[1], "-h"))
+		die("usage: dwmc command [argument]...");
+	for (i = 1; i < argc; i++) {
+		n = strlen(argv[i]);
+		if (len + n + 1 >= sizeof(line))
+			die("command too long");
+		if (strpbrk(argv[i], IPCSEP "\n"))
+			die("arguments must not contain tabs or newlines");
+		memcpy(line + len, argv[i], n);
+		len += n;
+		line[len++] = i + 1 < argc ? IPCSEP[0] : '\n';
+	}
 
-void
-toggletagex(const Arg *arg)
-{
-	toggletag(&((Arg) { .ui = 1 << arg->ui }));
-}
+	if (!dir || !*dir)
+		die("XDG_RUNTIME_DIR not set");
+	if (snprintf(addr.sun_path, sizeof(addr.sun_path), IPCSOCKET,
+	    dir, display ? display : "") >= (int)sizeof(addr.sun_path))
+		die("socket path too long");
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+	|| connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		perror("dwmc: connect");
+		return 1;
+	}
+	if (write(fd, line, len) != (ssize_t)len) {
+		perror("dwmc: write");
+		return 1;
+	}
 
-void
-tagall(const Arg *arg)
-{
-	tag(&((Arg){.ui = ~0}));
+	/* the answer is a single line */
+	for (len = 0; len < sizeof(line) - 1; len += r)
+		if ((r = read(fd, line + len, sizeof(line) - 1 - len)) <= 0
+		|| memchr(line + len, '\n', r)) {
+			len += r > 0 ? r : 0;
+			break;
+		}
+	line[len] = '\0';
+	if (!strncmp(line, "ok\n", 3) && !strcmp(argv[1], "subscribe")) {
+		/* events may have arrived along with the answer */
+		fwrite(line + 3, 1, len - 3, stdout);
+		do {
+			if (fflush(stdout))
+				return 1;
+		} while ((r = read(fd, line, sizeof(line))) > 0
+		&& fwrite(line, 1, r, stdout) == (size_t)r);
+		return r != 0;
+	}
+	close(fd);
+	if (!strncmp(line, "ok" IPCSEP, 3)) {
+		fputs(line + 3, stdout);
+		return 0;
+	}
+	if (!strncmp(line, "ok", 2))
+		return 0;
+	if ((p = strchr(line, '\n')))
+		*p = '\0';
+	if (!strncmp(line, "error" IPCSEP, 6))
+		die(line + 6);
+	die("no answer from dwm");
+	return 1;
 }
-
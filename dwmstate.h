@@ -0,0 +1,70 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * dwm publishes its state in a POSIX shared memory object, rewritten after
+ * every batch of events in which something changed. Map it read only:
+ *
+ *   snprintf(name, sizeof(name), DWMSTATE_NAME, getuid(), getenv("DISPLAY"));
+ *   fd = shm_open(name, O_RDONLY, 0);
+ *   shm = mmap(NULL, sizeof(DwmState), PROT_READ, MAP_SHARED, fd, 0);
+ *
+ * and take consistent copies with dwmstate_read(). The object is recreated
+ * when dwm restarts, so long running readers map it again once dwm's pid
+ * changes.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#define DWMSTATE_NAME       "/dwm-%u-%s" /* uid, $DISPLAY */
+#define DWMSTATE_VERSION    1
+#define DWMSTATE_MONITORS   16
+#define DWMSTATE_CLIENTS    256
+
+enum { DwmStateFloating = 1, DwmStateFullscreen = 2, DwmStateUrgent = 4 }; /* client flags */
+
+typedef struct {
+	int32_t num;
+	int32_t x, y, w, h;         /* screen */
+	uint32_t tagset;            /* viewed tags */
+	char ltsymbol[16];
+	float mfact;
+	int32_t nmaster;
+	uint64_t sel;               /* focused window, 0 if none */
+} DwmStateMonitor;
+
+typedef struct {
+	uint64_t win;
+	int32_t mon;                /* num of its monitor */
+	uint32_t tags;
+	int32_t x, y, w, h;
+	uint32_t flags;
+	char name[256];
+} DwmStateClient;
+
+typedef struct {
+	uint32_t seq;               /* odd while dwm is writing */
+	uint32_t version;
+	int32_t pid;
+	int32_t selmon;             /* num of the selected monitor */
+	uint32_t nmons, nclients;
+	DwmStateMonitor mons[DWMSTATE_MONITORS];
+	DwmStateClient clients[DWMSTATE_CLIENTS]; /* per monitor, in tiling order */
+} DwmState;
+
+/* Copies the state published at shm to out without blocking dwm, retrying
+ * while dwm writes. Returns 0 if no consistent copy was seen in tries. */
+static inline int
+dwmstate_read(const DwmState *shm, DwmState *out, int tries)
+{
+	uint32_t seq;
+
+	while (tries--) {
+		seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(out, (const void *)shm, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+			return 1;
+	}
+	return 0;
+}
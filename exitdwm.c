@@ -1,12 +1,6 @@
 # include <stdio.h>
 # include <string.h>
 
-void exitdwm(void)
-{
-
-if (system("dmenu -v &> /dev/null"))
-  return;
-
 # if							   \
 	defined S_LOCK				|| \
 	defined S_RESTART_DWM		|| \
@@ -41,7 +35,28 @@ if (system("dmenu -v &> /dev/null"))
 # define S_FORMAT(ACTION) S_##ACTION##_ICON " " S_##ACTION
 # define S_FORMAT_CLEAR "sed 's/^..//'"
 
-	FILE * exit_menu = popen (
+static void exitdwm_sh(const char *cmd)
+{
+	const char *argv[] = { "/bin/sh", "-c", cmd, NULL };
+
+	spawn (& (const Arg) { .v = argv });
+}
+
+static void exitdwm_chosen(const char *exit_action)
+{
+	if (strcmp (exit_action, S_LOCK) == 0) exitdwm_sh ("slock & sleep .5; xset dpms force off");
+    else if (strcmp (exit_action, S_RESTART_DWM) == 0) quit (& (const Arg) {1});
+    else if (strcmp (exit_action, S_OFFSCREEN) == 0) exitdwm_sh ("sleep .5; xset dpms force off");
+    else if (strcmp (exit_action, S_EXIT) == 0) quit (& (const Arg) {0});
+    else if (strcmp (exit_action, S_REBOOT) == 0) exitdwm_sh ("systemctl reboot");
+    else if (strcmp (exit_action, S_SHUTDOWN) == 0) exitdwm_sh ("systemctl poweroff -i");
+}
+
+/* The menu runs in the background, see runmenu(). Without dmenu it prints
+ * nothing and no action is taken. */
+void exitdwm(void)
+{
+	runmenu (
 		"echo \""
 			S_FORMAT (LOCK) "\n"
 			S_FORMAT (RESTART_DWM) "\n"
@@ -51,22 +66,9 @@ if (system("dmenu -v &> /dev/null"))
 			S_FORMAT (SHUTDOWN)
 			"\" | dmenu -c -l 6 -p EXIT: | " S_FORMAT_CLEAR
 		,
-		"r"
+		exitdwm_chosen
 	);
-
-	char exit_action [16];
-
-	if (exit_menu == NULL || fscanf (exit_menu, "%15[a-zA-Z -]", exit_action) == EOF) {
-	  pclose (exit_menu);
-    return;
-	} else if (strcmp (exit_action, S_LOCK) == 0) system ("slock & sleep .5; xset dpms force off");
-    else if (strcmp (exit_action, S_RESTART_DWM) == 0) quit (& (const Arg) {1});
-    else if (strcmp (exit_action, S_OFFSCREEN) == 0) system ("sleep .5; xset dpms force off");
-    else if (strcmp (exit_action, S_EXIT) == 0) quit (& (const Arg) {0});
-    else if (strcmp (exit_action, S_REBOOT) == 0) system ("systemctl reboot");
-    else if (strcmp (exit_action, S_SHUTDOWN) == 0) system ("systemctl poweroff -i");
-
-	pclose (exit_menu);
+}
 
 # undef S_LOCK
 # undef S_RESTART_DWM
@@ -82,4 +84,3 @@ if (system("dmenu -v &> /dev/null"))
 # undef S_SHUTDOWN_ICON
 # undef S_FORMAT
 # undef S_FORMAT_CLEAR
-}
@@ -0,0 +1,169 @@
+/*
+ * Icon scaling kernels, included by drw.c
+ *
+ * Straight alpha ARGB32 pixels are premultiplied and resampled with a box
+ * filter. The AVX2 and SSE2 kernels are picked at compile time, NOSIMD
+ * leaves only the scalar ones, see tests/iconkernels.c.
+ */
+#if !defined(NOSIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define ICON_AVX2
+#define ICON_SSE2
+#elif !defined(NOSIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define ICON_SSE2
+#endif
+
+typedef struct {
+	unsigned int start, n;
+} Span;
+
+/* (c * a) >> 8 for every colour channel of a pixel */
+static uint32_t
+premultiply1(uint32_t p)
+{
+	uint32_t a = p >> 24;
+	uint32_t rb = (a * (p & 0xff00ff)) >> 8;
+	uint32_t g = (a * (p & 0x00ff00)) >> 8;
+
+	return (rb & 0xff00ff) | (g & 0x00ff00) | (a << 24);
+}
+
+static void
+premultiply(uint32_t *px, size_t n)
+{
+	size_t i = 0;
+#ifdef ICON_AVX2
+	const __m256i zero8 = _mm256_setzero_si256(), amask8 = _mm256_set1_epi32(0xff000000);
+	__m256i p8, lo8, hi8;
+
+	for (; i + 8 <= n; i += 8) {
+		p8 = _mm256_loadu_si256((__m256i *)(px + i));
+		lo8 = _mm256_unpacklo_epi8(p8, zero8);
+		hi8 = _mm256_unpackhi_epi8(p8, zero8);
+		lo8 = _mm256_srli_epi16(_mm256_mullo_epi16(lo8,
+			_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo8, 0xff), 0xff)), 8);
+		hi8 = _mm256_srli_epi16(_mm256_mullo_epi16(hi8,
+			_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi8, 0xff), 0xff)), 8);
+		p8 = _mm256_or_si256(_mm256_andnot_si256(amask8, _mm256_packus_epi16(lo8, hi8)),
+			_mm256_and_si256(p8, amask8));
+		_mm256_storeu_si256((__m256i *)(px + i), p8);
+	}
+#endif
+#ifdef ICON_SSE2
+	const __m128i zero = _mm_setzero_si128(), amask = _mm_set1_epi32(0xff000000);
+	__m128i p, lo, hi;
+
+	for (; i + 4 <= n; i += 4) {
+		p = _mm_loadu_si128((__m128i *)(px + i));
+		lo = _mm_unpacklo_epi8(p, zero);
+		hi = _mm_unpackhi_epi8(p, zero);
+		lo = _mm_srli_epi16(_mm_mullo_epi16(lo,
+			_mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff)), 8);
+		hi = _mm_srli_epi16(_mm_mullo_epi16(hi,
+			_mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff)), 8);
+		p = _mm_or_si128(_mm_andnot_si128(amask, _mm_packus_epi16(lo, hi)),
+			_mm_and_si128(p, amask));
+		_mm_storeu_si128((__m128i *)(px + i), p);
+	}
+#endif
+	for (; i < n; i++)
+		px[i] = premultiply1(px[i]);
+}
+
+/* Box filter weights mapping 'sn' source pixels onto 'dn' destination
+ * pixels: destination pixel d averages the source pixels its footprint
+ * covers, weighted by coverage. Weights for d start at d * *stride. */
+static float *
+area_weights(unsigned int sn, unsigned int dn, Span *spans, unsigned int *stride)
+{
+	unsigned int d, i, k, e, max = (sn + dn - 1) / dn + 1;
+	float x0, x1, scale = (float)sn / dn, *w;
+
+	w = ecalloc((size_t)dn * max, sizeof(float));
+	for (d = 0; d < dn; d++) {
+		x0 = d * scale;
+		x1 = (d + 1) * scale;
+		spans[d].start = d * sn / dn;
+		e = MIN(((d + 1) * sn + dn - 1) / dn, sn);
+		spans[d].n = e - spans[d].start;
+		for (i = spans[d].start, k = 0; i < e; i++, k++)
+			w[d * max + k] = (MIN(i + 1, x1) - MAX(i, x0)) / scale;
+	}
+	*stride = max;
+	return w;
+}
+
+/* Separable area resampling of premultiplied ARGB32 pixels. Channels are
+ * accumulated as floats, one vector of four per pixel with SSE2. The two
+ * paths may differ by one in a channel: _mm_cvtps_epi32() rounds halves to
+ * even, the scalar path rounds them up, and the compiler may contract the
+ * scalar multiply-adds. Premultiplying is exact integer math in all paths. */
+static void
+resample(const uint32_t *src, unsigned int sw, unsigned int sh, uint32_t *dst, unsigned int dw, unsigned int dh)
+{
+	Span *xs = ecalloc(dw, sizeof(Span)), *ys = ecalloc(dh, sizeof(Span));
+	unsigned int xstride, ystride, x, y, k;
+	float *xw = area_weights(sw, dw, xs, &xstride);
+	float *yw = area_weights(sh, dh, ys, &ystride);
+	float *tmp = ecalloc((size_t)sh * dw * 4, sizeof(float)), *f, *wt;
+	const uint32_t *row;
+#ifdef ICON_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	__m128 acc;
+	__m128i v;
+#else
+	float acc[4];
+	unsigned int c;
+#endif
+
+	/* horizontal pass, sh rows of dw float pixels */
+	for (y = 0; y < sh; y++) {
+		for (x = 0; x < dw; x++) {
+			row = src + (size_t)y * sw + xs[x].start;
+			wt = xw + x * xstride;
+			f = tmp + ((size_t)y * dw + x) * 4;
+#ifdef ICON_SSE2
+			acc = _mm_setzero_ps();
+			for (k = 0; k < xs[x].n; k++) {
+				v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(row[k]), zero), zero);
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(wt[k])));
+			}
+			_mm_storeu_ps(f, acc);
+#else
+			f[0] = f[1] = f[2] = f[3] = 0;
+			for (k = 0; k < xs[x].n; k++)
+				for (c = 0; c < 4; c++)
+					f[c] += wt[k] * ((row[k] >> (c * 8)) & 0xff);
+#endif
+		}
+	}
+	/* vertical pass, straight into the destination */
+	for (y = 0; y < dh; y++) {
+		wt = yw + y * ystride;
+		for (x = 0; x < dw; x++) {
+			f = tmp + ((size_t)ys[y].start * dw + x) * 4;
+#ifdef ICON_SSE2
+			acc = _mm_setzero_ps();
+			for (k = 0; k < ys[y].n; k++, f += dw * 4)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(f), _mm_set1_ps(wt[k])));
+			v = _mm_cvtps_epi32(acc);
+			v = _mm_packus_epi16(_mm_packs_epi32(v, v), zero);
+			dst[(size_t)y * dw + x] = _mm_cvtsi128_si32(v);
+#else
+			acc[0] = acc[1] = acc[2] = acc[3] = 0;
+			for (k = 0; k < ys[y].n; k++, f += dw * 4)
+				for (c = 0; c < 4; c++)
+					acc[c] += wt[k] * f[c];
+			dst[(size_t)y * dw + x] = 0;
+			for (c = 0; c < 4; c++)
+				dst[(size_t)y * dw + x] |= (uint32_t)MIN(acc[c] + 0.5f, 255) << (c * 8);
+#endif
+		}
+	}
+	free(tmp);
+	free(yw);
+	free(xw);
+	free(ys);
+	free(xs);
+}
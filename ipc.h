@@ -0,0 +1,29 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * dwm listens on a unix stream socket for tab separated command lines:
+ *
+ *   <command>[\t<argument>]...\n
+ *
+ * and answers each of them with a single line, "ok" or "error\t<reason>".
+ * A client may keep the connection open for any number of commands, e.g.
+ * "block\t<name>\t<text>" updates for the status bar. Queries return their
+ * result after the "ok":
+ *
+ *   stats  ok\tspawns\t<count>\tlast\t<us>\tmean\t<us>\tmax\t<us>
+ *          programs started by dwm and the time it took to start them
+ *
+ * After "subscribe[\t<event>]..." the connection also receives event lines,
+ * first the current state and then whatever changes:
+ *
+ *   focus\t<monitor>\t<window>
+ *   tags\t<monitor>\t<viewed>\t<occupied>\t<urgent>
+ *   layout\t<monitor>\t<symbol>\t<mfact>\t<nmaster>
+ *   monitor\t<selected monitor>
+ *   map\t<window>\t<monitor>, unmap\t<window>            (event "client")
+ *   title\t<window>\t<title>
+ *   lost\t<count>                 events dropped because the reader fell behind
+ */
+
+#define IPCSOCKET "%s/dwm-%s.sock" /* $XDG_RUNTIME_DIR, $DISPLAY */
+#define IPCSEP    "\t"
+#define IPCMAXLINE 1024
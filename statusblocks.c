@@ -0,0 +1,169 @@
+/*
+ * Built-in status blocks
+ *
+ * Each reader returns the text for one block, or NULL if it has nothing to
+ * show. Files are opened once and read again with pread(), procfs and sysfs
+ * regenerate their contents on every read from offset 0.
+ */
+
+static const char *blk_battery(const char *arg, BlockState *st);
+static const char *blk_clock(const char *arg, BlockState *st);
+static const char *blk_cpu(const char *arg, BlockState *st);
+static const char *blk_load(const char *arg, BlockState *st);
+static const char *blk_mem(const char *arg, BlockState *st);
+static const char *blk_net(const char *arg, BlockState *st);
+
+/* Internals */
+static int blk_pread(int *fd, char *buf, size_t size, const char *path, const char *arg);
+static const char *blk_human(char *buf, size_t size, double n);
+static double blk_elapsed(BlockState *st);
+
+int
+blk_pread(int *fd, char *buf, size_t size, const char *path, const char *arg)
+{
+	char p[PATH_MAX];
+	ssize_t n;
+
+	if (*fd == -1) {
+		snprintf(p, sizeof(p), path, arg);
+		if ((*fd = open(p, O_RDONLY | O_CLOEXEC)) == -1)
+			return -1;
+	}
+	if ((n = pread(*fd, buf, size - 1, 0)) == -1) {
+		/* e.g. an unplugged battery, open it again next time */
+		close(*fd);
+		*fd = -1;
+		return -1;
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+const char *
+blk_human(char *buf, size_t size, double n)
+{
+	const char *units = "BKMGT";
+
+	for (; n >= 1024 && units[1]; units++)
+		n /= 1024;
+	snprintf(buf, size, n < 10 && *units != 'B' ? "%.1f%c" : "%.0f%c", n, *units);
+	return buf;
+}
+
+/* Seconds since the previous call for this block. */
+double
+blk_elapsed(BlockState *st)
+{
+	struct timespec now;
+	double dt;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	dt = (now.tv_sec - st->at.tv_sec) + (now.tv_nsec - st->at.tv_nsec) / 1e9;
+	st->at = now;
+	return dt;
+}
+
+/* arg: power supply, e.g. "BAT0". Shows + while charging, - while
+ * discharging, then the capacity. */
+const char *
+blk_battery(const char *arg, BlockState *st)
+{
+	char cap[8], status[32];
+
+	if (blk_pread(&st->fd[0], cap, sizeof(cap), "/sys/class/power_supply/%s/capacity", arg) <= 0
+	|| blk_pread(&st->fd[1], status, sizeof(status), "/sys/class/power_supply/%s/status", arg) <= 0)
+		return NULL;
+	cap[strcspn(cap, "\n")] = '\0';
+	snprintf(st->buf, sizeof(st->buf), "%s%s",
+		!strncmp(status, "Charging", 8) ? "+" : !strncmp(status, "Discharging", 11) ? "-" : "",
+		cap);
+	return st->buf;
+}
+
+/* arg: strftime(3) format */
+const char *
+blk_clock(const char *arg, BlockState *st)
+{
+	struct tm tm;
+	time_t t = time(NULL);
+
+	if (!localtime_r(&t, &tm) || !strftime(st->buf, sizeof(st->buf), arg, &tm))
+		return NULL;
+	return st->buf;
+}
+
+/* Busy time of all CPUs since the previous read, in percent. */
+const char *
+blk_cpu(const char *arg, BlockState *st)
+{
+	char buf[256];
+	unsigned long long v[8] = {0}, total = 0, idle, dt, di;
+	int i;
+
+	if (blk_pread(&st->fd[0], buf, sizeof(buf), "/proc/stat", NULL) <= 0
+	|| sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+	    &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4)
+		return NULL;
+	for (i = 0; i < LENGTH(v); i++)
+		total += v[i];
+	idle = v[3] + v[4]; /* idle and iowait */
+	dt = total - st->last[0];
+	di = idle - st->last[1];
+	st->last[0] = total;
+	st->last[1] = idle;
+	if (!dt)
+		return NULL;
+	snprintf(st->buf, sizeof(st->buf), "%llu", 100 * (dt - di) / dt);
+	return st->buf;
+}
+
+/* The one minute load average. */
+const char *
+blk_load(const char *arg, BlockState *st)
+{
+	if (blk_pread(&st->fd[0], st->buf, sizeof(st->buf), "/proc/loadavg", NULL) <= 0)
+		return NULL;
+	st->buf[strcspn(st->buf, " ")] = '\0';
+	return st->buf;
+}
+
+/* Memory in use, i.e. not available to new programs, in percent. */
+const char *
+blk_mem(const char *arg, BlockState *st)
+{
+	char buf[256], *p;
+	unsigned long long total, avail;
+
+	/* MemTotal and MemAvailable are among the first lines */
+	if (blk_pread(&st->fd[0], buf, sizeof(buf), "/proc/meminfo", NULL) <= 0
+	|| sscanf(buf, "MemTotal: %llu", &total) != 1 || !total
+	|| !(p = strstr(buf, "MemAvailable:")) || sscanf(p, "MemAvailable: %llu", &avail) != 1)
+		return NULL;
+	snprintf(st->buf, sizeof(st->buf), "%llu", 100 * (total - MIN(avail, total)) / total);
+	return st->buf;
+}
+
+/* arg: interface, e.g. "wlan0". Received and sent bytes per second since
+ * the previous read. */
+const char *
+blk_net(const char *arg, BlockState *st)
+{
+	char buf[32], rx[16], tx[16];
+	unsigned long long r, t;
+	double dt;
+
+	if (blk_pread(&st->fd[0], buf, sizeof(buf), "/sys/class/net/%s/statistics/rx_bytes", arg) <= 0
+	|| sscanf(buf, "%llu", &r) != 1
+	|| blk_pread(&st->fd[1], buf, sizeof(buf), "/sys/class/net/%s/statistics/tx_bytes", arg) <= 0
+	|| sscanf(buf, "%llu", &t) != 1)
+		return NULL;
+	dt = blk_elapsed(st);
+	if ((!st->last[0] && !st->last[1]) || r < st->last[0] || t < st->last[1])
+		dt = 0; /* no previous sample, or the counters were reset */
+	snprintf(st->buf, sizeof(st->buf), "%s/%s",
+		blk_human(rx, sizeof(rx), dt > 0 ? (r - st->last[0]) / dt : 0),
+		blk_human(tx, sizeof(tx), dt > 0 ? (t - st->last[1]) / dt : 0));
+	st->last[0] = r;
+	st->last[1] = t;
+	return st->buf;
+}
@@ -0,0 +1,87 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Checks that batched text is never drawn before rectangles queued ahead of
+ * it, also when the colour table of the text batch overflows. The X calls
+ * drw makes while flushing are wrapped at link time, no display is needed.
+ */
+#include "../drw.c"
+
+static Drw *drw;
+static int textdrawn, rectsdrawn, failed;
+
+int
+__wrap_XSetForeground(Display *dpy, GC gc, unsigned long pixel)
+{
+	return 0;
+}
+
+int
+__wrap_XFillRectangles(Display *dpy, Drawable d, GC gc, XRectangle *rects, int n)
+{
+	rectsdrawn += n;
+	return 0;
+}
+
+XftDraw *
+__wrap_XftDrawCreate(Display *dpy, Drawable d, Visual *visual, Colormap cmap)
+{
+	return (XftDraw *)drw;
+}
+
+Drawable
+__wrap_XftDrawDrawable(XftDraw *draw)
+{
+	return drw->drawable;
+}
+
+FT_UInt
+__wrap_XftCharIndex(Display *dpy, XftFont *font, FcChar32 ucs4)
+{
+	return ucs4;
+}
+
+void
+__wrap_XftGlyphExtents(Display *dpy, XftFont *font, const FT_UInt *glyphs, int n, XGlyphInfo *ext)
+{
+	memset(ext, 0, sizeof(*ext));
+	ext->xOff = 4;
+}
+
+void
+__wrap_XftDrawGlyphFontSpec(XftDraw *draw, const XftColor *clr, const XftGlyphFontSpec *specs, int n)
+{
+	/* every rect queued so far may lie under this text */
+	if (drw->batch->nrects) {
+		fprintf(stderr, "drwbatch: text drawn with %d rects still queued\n", drw->batch->nrects);
+		failed = 1;
+	}
+	textdrawn += n;
+}
+
+int
+main(void)
+{
+	Drw d = { 0 };
+	Fnt font = { 0 };
+	Clr clr = { 0 };
+	int i, n = 2 * LENGTH(d.batch->clrs) + 1;
+
+	drw = &d;
+	drw_setbatch(drw, 1);
+	/* each text over its own background, like drw_text() queues them,
+	 * and in a colour of its own to overflow the colour table */
+	for (i = 0; i < n; i++) {
+		batch_rect(drw, i, i * 10, 0, 10, 10);
+		clr.pixel = i;
+		clr.color.red = i;
+		batch_text(drw, &font, &clr, i * 10, 0, 10, 10, i * 10, 8, "ab", 2);
+	}
+	drw_flush(drw);
+	if (rectsdrawn != n || textdrawn != 2 * n) {
+		fprintf(stderr, "drwbatch: drew %d rects and %d glyphs, expected %d and %d\n",
+			rectsdrawn, textdrawn, n, 2 * n);
+		failed = 1;
+	}
+	free(drw->batch);
+	return failed;
+}
@@ -0,0 +1,114 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Times the CPU side of turning a _NET_WM_ICON into a bar icon: the former
+ * path, which premultiplied pixel by pixel and scaled with Imlib2 when the
+ * icon was more than twice the target size, against the kernels of
+ * iconscale.c. Icons at most twice the target size were scaled by the X
+ * server on every redraw before, that cost is not part of the figures.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <Imlib2.h>
+
+#include "../util.h"
+#include "../iconscale.c"
+
+#define LENGTH(X)   (sizeof (X) / sizeof (X)[0])
+
+/* premultiplication as done before */
+static uint32_t
+prealpha(uint32_t p)
+{
+	uint8_t a = p >> 24u;
+	uint32_t rb = (a * (p & 0xFF00FFu)) >> 8u;
+	uint32_t g = (a * (p & 0x00FF00u)) >> 8u;
+	return (rb & 0xFF00FFu) | (g & 0x00FF00u) | (a << 24u);
+}
+
+static void
+imlib2path(uint32_t *px, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh)
+{
+	Imlib_Image origin, scaled;
+	size_t i;
+
+	for (i = 0; i < (size_t)sw * sh; i++)
+		px[i] = prealpha(px[i]);
+	if (sw <= dw * 2 && sh <= dh * 2)
+		return;
+	if (!(origin = imlib_create_image_using_data(sw, sh, (DATA32 *)px)))
+		die("imlib_create_image_using_data failed");
+	imlib_context_set_image(origin);
+	imlib_image_set_has_alpha(1);
+	scaled = imlib_create_cropped_scaled_image(0, 0, sw, sh, dw, dh);
+	imlib_free_image_and_decache();
+	if (!scaled)
+		die("imlib_create_cropped_scaled_image failed");
+	imlib_context_set_image(scaled);
+	imlib_image_get_data_for_reading_only();
+	imlib_free_image_and_decache();
+}
+
+static void
+intreepath(uint32_t *px, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh)
+{
+	uint32_t *dst;
+
+	premultiply(px, (size_t)sw * sh);
+	if (sw == dw && sh == dh)
+		return;
+	dst = ecalloc((size_t)dw * dh, sizeof(uint32_t));
+	resample(px, sw, sh, dst, dw, dh);
+	free(dst);
+}
+
+/* Microseconds per call of path, each on a fresh copy of src. */
+static double
+timepath(void (*path)(uint32_t *, unsigned int, unsigned int, unsigned int, unsigned int),
+	const uint32_t *src, unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh, unsigned int n)
+{
+	struct timespec t0, t1;
+	uint32_t *px = ecalloc((size_t)sw * sh, sizeof(uint32_t));
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++) {
+		memcpy(px, src, (size_t)sw * sh * sizeof(uint32_t));
+		path(px, sw, sh, dw, dh);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	free(px);
+	return ((t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3) / n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const unsigned int sizes[] = { 16, 22, 24, 32, 48, 64, 96, 128, 256 };
+	unsigned int i, n, dst = argc > 1 ? atoi(argv[1]) : 20;
+	uint32_t *src, seed = 2463534242u;
+	size_t k;
+	double old, new;
+
+	if (!dst)
+		die("usage: iconbench [size]");
+	printf("%-9s  %-7s  %10s  %10s\n", "icon", "bar", "before us", "now us");
+	for (i = 0; i < LENGTH(sizes); i++) {
+		src = ecalloc((size_t)sizes[i] * sizes[i], sizeof(uint32_t));
+		for (k = 0; k < (size_t)sizes[i] * sizes[i]; k++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			src[k] = seed;
+		}
+		n = MAX(50000000 / (sizes[i] * sizes[i]), 100);
+		old = timepath(imlib2path, src, sizes[i], sizes[i], dst, dst, n);
+		new = timepath(intreepath, src, sizes[i], sizes[i], dst, dst, n);
+		printf("%4ux%-4u  %3ux%-3u  %10.2f  %10.2f\n", sizes[i], sizes[i], dst, dst, old, new);
+		free(src);
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Checks that the SIMD icon kernels agree with the scalar ones: premultiply()
+ * exactly for every alpha and channel byte, resample() within one per
+ * channel, its rounding differs between the two.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../util.h"
+#include "../iconscale.c"
+
+#define LENGTH(X)   (sizeof (X) / sizeof (X)[0])
+
+void scalar_premultiply(uint32_t *px, size_t n);
+void scalar_resample(const uint32_t *src, unsigned int sw, unsigned int sh, uint32_t *dst, unsigned int dw, unsigned int dh);
+
+static uint32_t seed = 2463534242u;
+
+static uint32_t
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static int
+checkpremultiply(void)
+{
+	/* all alpha and channel bytes, plus a tail for the narrower kernels */
+	size_t i, n = 256 * 256 + 7;
+	uint32_t *a = ecalloc(n, sizeof(uint32_t)), *b = ecalloc(n, sizeof(uint32_t));
+	unsigned int c;
+	int failed = 0;
+
+	for (i = 0; i < n; i++) {
+		c = i & 0xff;
+		a[i] = (uint32_t)(i >> 8 & 0xff) << 24 | c << 16 | (255 - c) << 8 | (c ^ 0x5a);
+	}
+	memcpy(b, a, n * sizeof(uint32_t));
+	premultiply(a, n);
+	scalar_premultiply(b, n);
+	for (i = 0; i < n && !failed; i++) {
+		if (a[i] != b[i]) {
+			fprintf(stderr, "iconkernels: premultiply gives %08x for pixel %zu, scalar %08x\n",
+				a[i], i, b[i]);
+			failed = 1;
+		}
+	}
+	free(a);
+	free(b);
+	return failed;
+}
+
+static int
+checkresample(unsigned int sw, unsigned int sh, unsigned int dw, unsigned int dh)
+{
+	uint32_t *src = ecalloc((size_t)sw * sh, sizeof(uint32_t));
+	uint32_t *a = ecalloc((size_t)dw * dh, sizeof(uint32_t));
+	uint32_t *b = ecalloc((size_t)dw * dh, sizeof(uint32_t));
+	size_t i;
+	int c, d, failed = 0;
+
+	for (i = 0; i < (size_t)sw * sh; i++)
+		src[i] = rnd();
+	scalar_premultiply(src, (size_t)sw * sh);
+	resample(src, sw, sh, a, dw, dh);
+	scalar_resample(src, sw, sh, b, dw, dh);
+	for (i = 0; i < (size_t)dw * dh && !failed; i++) {
+		for (c = 0; c < 32; c += 8) {
+			d = (int)(a[i] >> c & 0xff) - (int)(b[i] >> c & 0xff);
+			if (d < -1 || d > 1) {
+				fprintf(stderr, "iconkernels: %ux%u to %ux%u, pixel %zu is %08x, scalar %08x\n",
+					sw, sh, dw, dh, i, a[i], b[i]);
+				failed = 1;
+				break;
+			}
+		}
+	}
+	free(src);
+	free(a);
+	free(b);
+	return failed;
+}
+
+int
+main(void)
+{
+	static const unsigned int sizes[] = { 16, 22, 24, 32, 48, 64, 128, 256 };
+	static const unsigned int dsts[] = { 12, 16, 20, 28 };
+	unsigned int i, j;
+	int failed = checkpremultiply();
+
+	for (i = 0; i < LENGTH(sizes); i++)
+		for (j = 0; j < LENGTH(dsts); j++) {
+			failed |= checkresample(sizes[i], sizes[i], dsts[j], dsts[j]);
+			/* a wide icon keeps its aspect */
+			failed |= checkresample(sizes[i], sizes[i] / 2, dsts[j], MAX(dsts[j] / 2, 1));
+		}
+	return failed;
+}
@@ -0,0 +1,25 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * The scalar icon kernels, built apart so that tests/iconkernels.c can run
+ * them next to the SIMD ones.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../util.h"
+
+#define NOSIMD
+#include "../iconscale.c"
+
+void
+scalar_premultiply(uint32_t *px, size_t n)
+{
+	premultiply(px, n);
+}
+
+void
+scalar_resample(const uint32_t *src, unsigned int sw, unsigned int sh, uint32_t *dst, unsigned int dw, unsigned int dh)
+{
+	resample(src, sw, sh, dst, dw, dh);
+}
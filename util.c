@@ -16,6 +16,14 @@ ecalloc(size_t nmemb, size_t size)
 	return p;
 }
 
+void *
+erealloc(void *p, size_t size)
+{
+	if (!(p = realloc(p, size)))
+		die("realloc:");
+	return p;
+}
+
 void
 die(const char *fmt, ...) {
 	va_list ap;
@@ -40,7 +48,7 @@ die(const char *fmt, ...) {
  * 'pbegin'. Only the first 'maxcount' segments will be written if
  * maxcount > 0. Inspired by python's split.
  *
- * Used exclusively by fakesignal() to split arguments.
+ * Used by ipccommand() to split command lines.
  */
 size_t
 split(char *s, const char* sep, char **pbegin, size_t maxcount) {
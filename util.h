@@ -6,4 +6,5 @@
 
 void die(const char *fmt, ...);
 void *ecalloc(size_t nmemb, size_t size);
+void *erealloc(void *p, size_t size);
 size_t split(char *s, const char* sep, char **pbegin, size_t maxcount);
@@ -0,0 +1,190 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Single worker thread for work that must not stall the event loop. Jobs
+ * and results travel through two single producer, single consumer rings,
+ * so neither side ever takes a lock. Each side sleeps on a file descriptor
+ * (an eventfd on Linux, a pipe elsewhere) which the other side writes to
+ * after queueing; the event thread polls the result descriptor along with
+ * the X connection.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "worker.h"
+
+#define RINGSIZE 64 /* jobs in flight, must be a power of two */
+
+typedef struct {
+	Job *slot[RINGSIZE];
+	unsigned int head, tail;
+} Ring;
+
+typedef struct {
+	int rfd, wfd;
+} Signal;
+
+static Ring jobs, results;
+static Signal wake, ready;
+static pthread_t thread;
+static unsigned int inflight;
+static int quit, started;
+
+static int
+ring_push(Ring *r, Job *job)
+{
+	unsigned int tail = r->tail;
+
+	if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RINGSIZE)
+		return 0;
+	r->slot[tail & (RINGSIZE - 1)] = job;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static Job *
+ring_pop(Ring *r)
+{
+	unsigned int head = r->head;
+	Job *job;
+
+	if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	job = r->slot[head & (RINGSIZE - 1)];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return job;
+}
+
+static int
+signal_open(Signal *s, int nonblock)
+{
+#ifdef __linux__
+	if ((s->rfd = s->wfd = eventfd(0, EFD_CLOEXEC | (nonblock ? EFD_NONBLOCK : 0))) == -1)
+		return -1;
+#else
+	int fds[2];
+
+	if (pipe(fds) == -1)
+		return -1;
+	s->rfd = fds[0];
+	s->wfd = fds[1];
+	fcntl(s->rfd, F_SETFD, FD_CLOEXEC);
+	fcntl(s->wfd, F_SETFD, FD_CLOEXEC);
+	fcntl(s->wfd, F_SETFL, O_NONBLOCK);
+	if (nonblock)
+		fcntl(s->rfd, F_SETFL, O_NONBLOCK);
+#endif
+	return 0;
+}
+
+static void
+signal_close(Signal *s)
+{
+	close(s->rfd);
+	if (s->wfd != s->rfd)
+		close(s->wfd);
+}
+
+static void
+signal_raise(Signal *s)
+{
+	uint64_t one = 1;
+
+	/* a full pipe already means there is a wakeup pending */
+	while (write(s->wfd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+static void
+signal_clear(Signal *s)
+{
+	char buf[64];
+
+	/* whatever a pipe still holds afterwards is only a spurious wakeup */
+	while (read(s->rfd, buf, sizeof(buf)) == -1 && errno == EINTR);
+}
+
+static void *
+worker_main(void *unused)
+{
+	Job *job;
+
+	for (;;) {
+		signal_clear(&wake);
+		if (__atomic_load_n(&quit, __ATOMIC_ACQUIRE))
+			break;
+		while ((job = ring_pop(&jobs))) {
+			job->run(job);
+			ring_push(&results, job); /* cannot fail, see worker_submit() */
+			signal_raise(&ready);
+		}
+	}
+	return NULL;
+}
+
+/* Returns the descriptor the event loop has to poll for worker_drain(), or
+ * -1 if no thread could be started, in which case callers do the work
+ * themselves. */
+int
+worker_start(void)
+{
+	if (signal_open(&wake, 0) == -1)
+		return -1;
+	if (signal_open(&ready, 1) == -1) {
+		signal_close(&wake);
+		return -1;
+	}
+	if (pthread_create(&thread, NULL, worker_main, NULL)) {
+		signal_close(&wake);
+		signal_close(&ready);
+		return -1;
+	}
+	started = 1;
+	return ready.rfd;
+}
+
+/* Stops the thread once it finished its current job, jobs still queued
+ * are dropped without their done() being called. */
+void
+worker_stop(void)
+{
+	if (!started)
+		return;
+	__atomic_store_n(&quit, 1, __ATOMIC_RELEASE);
+	signal_raise(&wake);
+	pthread_join(thread, NULL);
+	signal_close(&wake);
+	signal_close(&ready);
+	started = 0;
+}
+
+/* Returns 0 if the job was not queued and has to be done synchronously. */
+int
+worker_submit(Job *job)
+{
+	/* results has room for every job in flight, so the worker never
+	 * has to wait for the event thread */
+	if (!started || inflight == RINGSIZE || !ring_push(&jobs, job))
+		return 0;
+	inflight++;
+	signal_raise(&wake);
+	return 1;
+}
+
+void
+worker_drain(void)
+{
+	Job *job;
+
+	if (!started)
+		return;
+	signal_clear(&ready);
+	while ((job = ring_pop(&results))) {
+		inflight--;
+		job->done(job);
+	}
+}
@@ -0,0 +1,16 @@
+/* See LICENSE file for copyright and license details. */
+
+/* A job is handed to the worker thread, which calls run(), and then back to
+ * the event thread, which calls done() from worker_drain(). Embed it as the
+ * first member of a struct carrying the job's data. run() must not touch
+ * the display or any state the event thread may change meanwhile. */
+typedef struct Job Job;
+struct Job {
+	void (*run)(Job *job);
+	void (*done)(Job *job);
+};
+
+int worker_start(void);
+void worker_stop(void);
+int worker_submit(Job *job);
+void worker_drain(void);